@@ -1,29 +1,54 @@
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <algorithm>
 #include "Core/Memory.h"
 #include "Core/Utils.h"
 
-void *xmalloc(int n)
+void *xmalloc(int64_t n)
 {
+	NG_ASSERT(n >= 0);
 	void *mem = malloc(n);
 	if (!mem)
 		die("nextgame: out of memory");
 	return mem;
 }
 
+// Large blocks come from mmap in glibc and are grown with mremap, their pages
+// are moved rather than copied.
+void *xrealloc(void *ptr, int64_t n)
+{
+	NG_ASSERT(n > 0);
+	void *mem = realloc(ptr, n);
+	if (!mem)
+		die("nextgame: out of memory");
+	return mem;
+}
+
+// Memory from it is freed by xfree() as well.
+void *xmalloc_aligned(int64_t n, int alignment)
+{
+	NG_ASSERT(n >= 0);
+	NG_ASSERT(alignment > 0 && (alignment & (alignment - 1)) == 0);
+	void *mem = nullptr;
+	const size_t a = std::max<size_t>(alignment, sizeof(void*));
+	if (posix_memalign(&mem, a, n) != 0)
+		die("nextgame: out of memory");
+	return mem;
+}
+
 void xfree(void *ptr)
 {
 	free(ptr);
 }
 
-int xcopy(void *dst, const void *src, int n)
+int64_t xcopy(void *dst, const void *src, int64_t n)
 {
 	memmove(dst, src, n);
 	return n;
 }
 
-void xclear(void *dst, int n)
+void xclear(void *dst, int64_t n)
 {
 	memset(dst, 0, n);
 }
@@ -44,4 +69,79 @@ void *operator new[](size_t size, const OrDie_t &)
 	return mem;
 }
 
+Arena::~Arena()
+{
+	ArenaBlock *b = first;
+	while (b) {
+		ArenaBlock *next = b->next;
+		xfree(b);
+		b = next;
+	}
+}
 
+// the offset of the first 'alignment' aligned address at or after 'offset'
+static int64_t align_offset(ArenaBlock *b, int64_t offset, int alignment)
+{
+	const uintptr_t p = (uintptr_t)(b->data() + offset);
+	const uintptr_t aligned = (p + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	return offset + int64_t(aligned - p);
+}
+
+void *Arena::allocate(int64_t n, int alignment)
+{
+	NG_ASSERT(n >= 0);
+	NG_ASSERT(alignment > 0 && (alignment & (alignment - 1)) == 0);
+	if (current) {
+		const int64_t offset = align_offset(current, used, alignment);
+		if (offset + n <= current->size) {
+			used = offset + n;
+			return current->data() + offset;
+		}
+	}
+
+	// the next free block if it's large enough, a new one otherwise, the
+	// free one stays for later
+	ArenaBlock *next = current ? current->next : first;
+	if (!next || align_offset(next, 0, alignment) + n > next->size) {
+		const int64_t size = std::max<int64_t>(block_size, n + alignment);
+		ArenaBlock *b = (ArenaBlock*)xmalloc(sizeof(ArenaBlock) + size);
+		b->size = size;
+		b->next = next;
+		if (current)
+			current->next = b;
+		else
+			first = b;
+		next = b;
+	}
+	current = next;
+	used = align_offset(current, 0, alignment) + n;
+	return current->data() + used - n;
+}
+
+void *Arena::reallocate(void *ptr, int64_t old_n, int64_t n, int alignment)
+{
+	NG_ASSERT(old_n >= 0 && n >= 0);
+	if (ptr && current && (char*)ptr + old_n == current->data() + used) {
+		const int64_t offset = (char*)ptr - current->data();
+		if (offset + n <= current->size) {
+			used = offset + n;
+			return ptr;
+		}
+	}
+	void *mem = allocate(n, alignment);
+	if (ptr)
+		xcopy(mem, ptr, std::min(old_n, n));
+	return mem;
+}
+
+void Arena::reset(const ArenaMark &m)
+{
+	current = m.block;
+	used = m.used;
+}
+
+Arena *scratch_arena()
+{
+	static thread_local Arena arena;
+	return &arena;
+}
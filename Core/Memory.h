@@ -1,14 +1,19 @@
 #pragma once
 
+#include <algorithm>
 #include <new>
 #include <utility>
 #include <type_traits>
 #include <cstddef>
+#include <cstdint>
+#include "Core/Utils.h"
 
-void *xmalloc(int n);
+void *xmalloc(int64_t n);
+void *xrealloc(void *ptr, int64_t n);
+void *xmalloc_aligned(int64_t n, int alignment);
 void xfree(void *ptr);
-int xcopy(void *dst, const void *src, int n);
-void xclear(void *dst, int n);
+int64_t xcopy(void *dst, const void *src, int64_t n);
+void xclear(void *dst, int64_t n);
 
 struct OrDie_t {};
 const OrDie_t OrDie = {};
@@ -17,7 +22,7 @@ void *operator new(size_t size, const OrDie_t&);
 void *operator new[](size_t size, const OrDie_t&);
 
 template <typename T>
-T *allocate_memory(int n = 1)
+T *allocate_memory(int64_t n = 1)
 {
 	return (T*)xmalloc(sizeof(T) * n);
 }
@@ -36,13 +41,185 @@ void free_memory(T *ptr)
 }
 
 template <typename T>
-int copy_memory(T *dst, const T *src, int n = 1)
+int64_t copy_memory(T *dst, const T *src, int64_t n = 1)
 {
 	return xcopy(dst, src, sizeof(T) * n);
 }
 
 template <typename T>
-void clear_memory(T *dst, int n = 1)
+void clear_memory(T *dst, int64_t n = 1)
 {
 	xclear(dst, sizeof(T)*n);
 }
+
+// Objects which can be moved to another address by copying their bytes, the
+// old ones are then forgotten without being destroyed. Trivially copyable
+// types are, others which don't point into themselves (or get pointed to by
+// what they own) can say so by specializing this.
+template <typename T>
+struct IsTriviallyRelocatable {
+	static constexpr bool value = std::is_trivially_copyable<T>::value;
+};
+
+//----------------------------------------------------------------------------
+// Arenas
+//----------------------------------------------------------------------------
+
+struct ArenaBlock {
+	ArenaBlock *next;
+	int64_t size;
+
+	// the memory follows the header
+	char *data() { return (char*)(this + 1); }
+};
+
+// Position in an arena, what was allocated after it can be freed at once.
+struct ArenaMark {
+	ArenaBlock *block;
+	int64_t used;
+};
+
+// Bump allocator: allocations are carved one after another out of blocks of
+// memory, which are only given back all at once, by reset() or by going back
+// to a mark. Blocks are kept for reuse, once an arena grew to what its user
+// needs it doesn't call malloc anymore. Nothing in an arena is destroyed,
+// objects living there have to be trivially destructible or destroyed by
+// hand.
+struct Arena {
+	// blocks in the order they're used in, the ones after 'current' are free
+	ArenaBlock *first = nullptr;
+	ArenaBlock *current = nullptr;
+	int64_t used = 0;
+	int block_size;
+
+	NG_DELETE_COPY_AND_MOVE(Arena);
+
+	explicit Arena(int block_size = 64 * 1024): block_size(block_size) {}
+	~Arena();
+
+	void *allocate(int64_t n, int alignment = alignof(std::max_align_t));
+
+	// Resizes an allocation of 'old_n' bytes, in place if it's the last one
+	// made, moving its bytes to a new allocation otherwise.
+	void *reallocate(void *ptr, int64_t old_n, int64_t n,
+		int alignment = alignof(std::max_align_t));
+
+	ArenaMark mark() const { return {current, used}; }
+	void reset(const ArenaMark &m);
+
+	// frees everything, keeps the blocks
+	void reset() { reset({nullptr, 0}); }
+};
+
+// Puts the arena back where it was when the scope started.
+struct ArenaScope {
+	Arena *arena;
+	ArenaMark mark;
+
+	NG_DELETE_COPY_AND_MOVE(ArenaScope);
+
+	explicit ArenaScope(Arena *arena): arena(arena), mark(arena->mark()) {}
+	~ArenaScope() { arena->reset(mark); }
+};
+
+// Arena of the calling thread for temporary memory. Allocations from it are
+// made under an ArenaScope, which gives them back.
+Arena *scratch_arena();
+
+// Two arenas taking turns: memory allocated during a frame stays valid until
+// the end of the next one, then it's reused. Data can be handed from a frame
+// to the next one without copying or freeing it.
+struct FrameAllocator {
+	Arena arenas[2];
+	int frame = 0;
+
+	void *allocate(int64_t n, int alignment = alignof(std::max_align_t))
+	{
+		return arenas[frame & 1].allocate(n, alignment);
+	}
+
+	// frees what was allocated during the frame before the last one
+	void next_frame()
+	{
+		frame++;
+		arenas[frame & 1].reset();
+	}
+};
+
+template <typename T>
+T *allocate_memory(Arena *arena, int64_t n = 1)
+{
+	return (T*)arena->allocate(sizeof(T) * n, alignof(T));
+}
+
+template <typename T>
+T *allocate_memory(FrameAllocator *frame, int64_t n = 1)
+{
+	return (T*)frame->allocate(sizeof(T) * n, alignof(T));
+}
+
+//----------------------------------------------------------------------------
+// Allocator policies, for Vector
+//----------------------------------------------------------------------------
+
+// Policies have allocate(n, alignment), free(ptr) and reallocate(ptr, old_n,
+// n, alignment), the last one moves the bytes of an allocation, it's only
+// used for trivially relocatable objects.
+
+// The heap, through xmalloc/xfree. The default, it has no state and costs
+// nothing over calling them directly. Alignments above what malloc gives go
+// through xmalloc_aligned, realloc wouldn't keep them.
+struct HeapAllocator {
+	static bool over_aligned(int alignment) { return alignment > (int)alignof(std::max_align_t); }
+
+	void *allocate(int64_t n, int alignment)
+	{
+		return over_aligned(alignment) ? xmalloc_aligned(n, alignment) : xmalloc(n);
+	}
+	void *reallocate(void *ptr, int64_t old_n, int64_t n, int alignment)
+	{
+		if (!over_aligned(alignment))
+			return xrealloc(ptr, n);
+		void *mem = xmalloc_aligned(n, alignment);
+		if (ptr) {
+			xcopy(mem, ptr, std::min(old_n, n));
+			xfree(ptr);
+		}
+		return mem;
+	}
+	void free(void *ptr) { xfree(ptr); }
+};
+
+// An arena, the memory is given back when the arena is reset and free()
+// does nothing. A vector growing in an arena leaves its old memory behind
+// until then, unless it's the last thing allocated there.
+struct ArenaAllocator {
+	Arena *arena = nullptr;
+
+	ArenaAllocator() = default;
+	explicit ArenaAllocator(Arena *arena): arena(arena) {}
+
+	void *allocate(int64_t n, int alignment)
+	{
+		NG_ASSERT(arena != nullptr);
+		return arena->allocate(n, alignment);
+	}
+	void *reallocate(void *ptr, int64_t old_n, int64_t n, int alignment)
+	{
+		NG_ASSERT(arena != nullptr);
+		return arena->reallocate(ptr, old_n, n, alignment);
+	}
+	void free(void*) {}
+};
+
+// The scratch arena of the thread allocating. For temporaries made and grown
+// by a single thread under an ArenaScope of its scratch arena, they have to
+// go away before the scope does.
+struct ScratchAllocator {
+	void *allocate(int64_t n, int alignment) { return scratch_arena()->allocate(n, alignment); }
+	void *reallocate(void *ptr, int64_t old_n, int64_t n, int alignment)
+	{
+		return scratch_arena()->reallocate(ptr, old_n, n, alignment);
+	}
+	void free(void*) {}
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "Core/Scheduler.h"
+#include "Core/Slice.h"
+#include "Core/Vector.h"
+
+//----------------------------------------------------------------------------
+// Parallel algorithms over ranges and slices
+//----------------------------------------------------------------------------
+
+// The work is cut into pieces of 'grain' elements (the last one may be
+// shorter) which run as tasks of the scheduler. A grain of 0 or less picks
+// one giving every thread of the scheduler a few pieces. A single piece runs
+// on the calling thread, without involving the scheduler at all.
+
+static inline int64_t parallel_grain(int64_t n, int64_t grain, const Scheduler *scheduler)
+{
+	if (grain > 0)
+		return grain;
+	const int64_t pieces = (scheduler->num_workers() + 1) * 4;
+	return std::max<int64_t>(1, (n + pieces - 1) / pieces);
+}
+
+// Calls f(piece) for every piece in [0, n_pieces), the range is split in
+// halves which go to other threads until a single piece is left.
+template <typename F>
+static void _parallel_pieces(TaskGroup *group, int64_t begin, int64_t end, const F &f)
+{
+	while (end - begin > 1) {
+		const int64_t mid = begin + (end - begin) / 2;
+		group->run([group, mid, end, &f] { _parallel_pieces(group, mid, end, f); });
+		end = mid;
+	}
+	f(begin);
+}
+
+template <typename F>
+static void _parallel_pieces(int64_t n_pieces, Scheduler *scheduler, const F &f)
+{
+	if (n_pieces == 1) {
+		f(0);
+		return;
+	}
+	TaskGroup group(scheduler);
+	_parallel_pieces(&group, 0, n_pieces, f);
+	group.wait();
+}
+
+// Calls f(begin, end) for consecutive ranges covering [0, n).
+template <typename F>
+void parallel_for(int64_t n, int64_t grain, F &&f, Scheduler *scheduler = default_scheduler())
+{
+	if (n <= 0)
+		return;
+	grain = parallel_grain(n, grain, scheduler);
+	_parallel_pieces((n + grain - 1) / grain, scheduler, [&](int64_t piece) {
+		const int64_t begin = piece * grain;
+		f(begin, std::min(begin + grain, n));
+	});
+}
+
+// Calls f(piece) for consecutive sub-slices covering the slice.
+template <typename T, typename F>
+void parallel_for(Slice<T> s, int64_t grain, F &&f, Scheduler *scheduler = default_scheduler())
+{
+	parallel_for(s.length, grain, [&](int64_t begin, int64_t end) {
+		f(s.sub(begin, end));
+	}, scheduler);
+}
+
+// Reduces every piece with map(piece) and the results with combine(a, b),
+// starting from 'identity'. Results are combined in the order of the pieces,
+// for a given grain the result doesn't depend on the scheduling, floating
+// point sums included.
+template <typename T, typename R, typename Map, typename Combine>
+R parallel_reduce(Slice<T> s, int64_t grain, const R &identity, Map &&map, Combine &&combine,
+	Scheduler *scheduler = default_scheduler())
+{
+	if (s.length == 0)
+		return identity;
+	grain = parallel_grain(s.length, grain, scheduler);
+	const int64_t n_pieces = (s.length + grain - 1) / grain;
+	ArenaScope scope(scratch_arena());
+	ScratchVector<R> results(n_pieces);
+	_parallel_pieces(n_pieces, scheduler, [&](int64_t piece) {
+		const int64_t begin = piece * grain;
+		results[piece] = map(s.sub(begin, std::min(begin + grain, s.length)));
+	});
+
+	R r = identity;
+	for (const R &v : results)
+		r = combine(r, v);
+	return r;
+}
+
+// Exclusive scan: out[i] = op(...op(op(identity, in[0]), in[1])..., in[i-1]),
+// returns the combination of all of 'in'. 'op' has to be associative. 'in'
+// and 'out' may be the same memory. Pieces are summed up in parallel, their
+// totals scanned, then pieces are scanned in parallel from there.
+template <typename T, typename U, typename Op>
+U parallel_scan(Slice<T> in, Slice<U> out, const U &identity, Op &&op, int64_t grain = 0,
+	Scheduler *scheduler = default_scheduler())
+{
+	NG_ASSERT(in.length == out.length);
+	const int64_t n = in.length;
+	if (n == 0)
+		return identity;
+	grain = parallel_grain(n, grain, scheduler);
+	const int64_t n_pieces = (n + grain - 1) / grain;
+	ArenaScope scope(scratch_arena());
+	ScratchVector<U> offsets(n_pieces, identity);
+	U total = identity;
+	if (n_pieces > 1) {
+		_parallel_pieces(n_pieces, scheduler, [&](int64_t piece) {
+			const int64_t begin = piece * grain;
+			const int64_t end = std::min(begin + grain, n);
+			U sum = in.data[begin];
+			for (int64_t i = begin + 1; i < end; i++)
+				sum = op(sum, in.data[i]);
+			offsets[piece] = sum;
+		});
+		for (U &v : offsets) {
+			const U sum = v;
+			v = total;
+			total = op(total, sum);
+		}
+	}
+
+	_parallel_pieces(n_pieces, scheduler, [&](int64_t piece) {
+		const int64_t begin = piece * grain;
+		const int64_t end = std::min(begin + grain, n);
+		U acc = offsets[piece];
+		for (int64_t i = begin; i < end; i++) {
+			const U v = in.data[i];
+			out.data[i] = acc;
+			acc = op(acc, v);
+		}
+		// a single piece computes the total on the way
+		if (n_pieces == 1)
+			total = acc;
+	});
+	return total;
+}
+
+// The exclusive prefix sum of a slice, in place, returns the sum of all of it.
+template <typename T>
+T parallel_scan(Slice<T> s, int64_t grain = 0, Scheduler *scheduler = default_scheduler())
+{
+	return parallel_scan(s, s, T(0),
+		[](const T &a, const T &b) { return a + b; }, grain, scheduler);
+}
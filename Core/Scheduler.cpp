@@ -0,0 +1,310 @@
+#include "Core/Scheduler.h"
+
+#ifdef __linux__
+	#include <pthread.h>
+	#include <sched.h>
+#endif
+
+//----------------------------------------------------------------------------
+// Chase-Lev deque
+//----------------------------------------------------------------------------
+
+// Ring buffer of tasks, 'mask + 1' is a power of two. Slots are atomic, a
+// thief may read one the owner is about to overwrite, it just fails to take
+// it afterwards.
+struct TaskArray {
+	int64_t mask;
+	std::atomic<Task*> *slots;
+
+	explicit TaskArray(int64_t size): mask(size - 1), slots(new std::atomic<Task*>[size]) {}
+	~TaskArray() { delete[] slots; }
+
+	Task *get(int64_t i) const { return slots[i & mask].load(std::memory_order_relaxed); }
+	void put(int64_t i, Task *t) { slots[i & mask].store(t, std::memory_order_relaxed); }
+};
+
+// Tasks of a worker, see "Correct and Efficient Work-Stealing for Weak
+// Memory Models" (Lê et al.) for the memory orderings. [top, bottom) are
+// queued, the owner works at the bottom, thieves at the top.
+struct TaskDeque {
+	std::atomic<int64_t> top;
+	std::atomic<int64_t> bottom;
+	std::atomic<TaskArray*> array;
+
+	// arrays the deque grew out of, a thief may still be reading them
+	Vector<TaskArray*> retired;
+
+	TaskDeque(): top(0), bottom(0), array(new TaskArray(256)) {}
+	~TaskDeque()
+	{
+		delete array.load();
+		for (TaskArray *a : retired)
+			delete a;
+	}
+
+	// owner only
+	void push(Task *t)
+	{
+		const int64_t b = bottom.load(std::memory_order_relaxed);
+		const int64_t top_ = top.load(std::memory_order_acquire);
+		TaskArray *a = array.load(std::memory_order_relaxed);
+		if (b - top_ > a->mask) {
+			TaskArray *bigger = new TaskArray((a->mask + 1) * 2);
+			for (int64_t i = top_; i < b; i++)
+				bigger->put(i, a->get(i));
+			retired.append(a);
+			array.store(bigger, std::memory_order_release);
+			a = bigger;
+		}
+		a->put(b, t);
+		bottom.store(b + 1, std::memory_order_release);
+	}
+
+	// owner only, the most recently pushed task
+	Task *take()
+	{
+		const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		TaskArray *a = array.load(std::memory_order_relaxed);
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_relaxed);
+		if (t > b) {
+			// empty
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+		Task *task = a->get(b);
+		if (t == b) {
+			// the last one, thieves may be after it too
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+				std::memory_order_relaxed))
+			{
+				task = nullptr;
+			}
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return task;
+	}
+
+	// any thread, the least recently pushed task, nullptr if there's none
+	// or another thread got it first
+	Task *steal()
+	{
+		int64_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const int64_t b = bottom.load(std::memory_order_acquire);
+		if (t >= b)
+			return nullptr;
+		TaskArray *a = array.load(std::memory_order_acquire);
+		Task *task = a->get(t);
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+			std::memory_order_relaxed))
+		{
+			return nullptr;
+		}
+		return task;
+	}
+};
+
+//----------------------------------------------------------------------------
+// Scheduler
+//----------------------------------------------------------------------------
+
+// the scheduler the calling thread is a worker of and its index there
+static thread_local const Scheduler *worker_scheduler = nullptr;
+static thread_local int worker_index = -1;
+
+// xorshift state for picking victims
+static thread_local uint32_t steal_seed = 0;
+
+static uint32_t next_random()
+{
+	uint32_t x = steal_seed;
+	if (x == 0)
+		x = uint32_t(uintptr_t(&steal_seed)) | 1;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	steal_seed = x;
+	return x;
+}
+
+// wakes up sleeping threads after something they may be waiting for happened
+static void signal(Scheduler *s, bool all)
+{
+	s->epoch.fetch_add(1);
+	if (s->sleepers.load() == 0)
+		return;
+	std::lock_guard<std::mutex> lock(s->mutex);
+	if (all)
+		s->wake.notify_all();
+	else
+		s->wake.notify_one();
+}
+
+static Task *take_injected(Scheduler *s)
+{
+	if (s->num_injected.load(std::memory_order_relaxed) == 0)
+		return nullptr;
+	std::lock_guard<std::mutex> lock(s->mutex);
+	if (s->injected_head == s->injected.length())
+		return nullptr;
+	Task *t = s->injected[s->injected_head++];
+	if (s->injected_head == s->injected.length()) {
+		s->injected.clear();
+		s->injected_head = 0;
+	}
+	s->num_injected.fetch_sub(1, std::memory_order_relaxed);
+	return t;
+}
+
+// A task for the given worker (-1 for other threads): its own newest, a
+// submitted one, or one stolen from a random worker.
+static Task *find_task(Scheduler *s, int worker)
+{
+	if (worker >= 0) {
+		if (Task *t = s->deques[worker]->take())
+			return t;
+	}
+	if (Task *t = take_injected(s))
+		return t;
+
+	const int n = s->deques.length();
+	const int first = next_random() % n;
+	for (int i = 0; i < n; i++) {
+		const int victim = (first + i) % n;
+		if (victim == worker)
+			continue;
+		if (Task *t = s->deques[victim]->steal())
+			return t;
+	}
+	return nullptr;
+}
+
+static void run_task(Scheduler *s, Task *t)
+{
+	TaskGroup *group = t->group;
+	t->execute(t);
+	if (group->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		signal(s, true);
+}
+
+// Sleeps until the epoch moves past 'e' or 'done()' holds. The caller reads
+// 'e' before looking for tasks, so that a task which came after that isn't
+// slept through.
+template <typename F>
+static void sleep(Scheduler *s, uint64_t e, F &&done)
+{
+	std::unique_lock<std::mutex> lock(s->mutex);
+	s->sleepers.fetch_add(1);
+	s->wake.wait(lock, [&] { return s->epoch.load() != e || s->quit || done(); });
+	s->sleepers.fetch_sub(1);
+}
+
+static void work(Scheduler *s, int worker)
+{
+	worker_scheduler = s;
+	worker_index = worker;
+	for (;;) {
+		const uint64_t e = s->epoch.load();
+		if (Task *t = find_task(s, worker)) {
+			run_task(s, t);
+			continue;
+		}
+		{
+			std::lock_guard<std::mutex> lock(s->mutex);
+			if (s->quit)
+				return;
+		}
+		sleep(s, e, [] { return false; });
+	}
+}
+
+static void pin_thread(std::thread *t, int core)
+{
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core, &set);
+	if (pthread_setaffinity_np(t->native_handle(), sizeof(set), &set) != 0)
+		warn("failed to pin a worker thread to core %d", core);
+#else
+	(void)t;
+	(void)core;
+#endif
+}
+
+Scheduler::Scheduler(int num_threads, bool pin_threads):
+	num_injected(0), epoch(0), sleepers(0)
+{
+	const int num_cores = std::max(1U, std::thread::hardware_concurrency());
+	if (num_threads <= 0)
+		num_threads = num_cores;
+
+	// every deque exists before any worker looks for something to steal
+	deques.reserve(num_threads);
+	for (int i = 0; i < num_threads; i++)
+		deques.append(new TaskDeque);
+
+	threads.reserve(num_threads);
+	for (int i = 0; i < num_threads; i++) {
+		threads.pappend(work, this, i);
+		if (pin_threads)
+			pin_thread(&threads.last(), i % num_cores);
+	}
+}
+
+Scheduler::~Scheduler()
+{
+	// workers only quit once there is nothing left to run
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	signal(this, true);
+	for (std::thread &t : threads)
+		t.join();
+	for (TaskDeque *d : deques)
+		delete d;
+}
+
+int Scheduler::current_worker() const
+{
+	return worker_scheduler == this ? worker_index : -1;
+}
+
+void Scheduler::submit(Task *task)
+{
+	const int worker = current_worker();
+	if (worker >= 0) {
+		deques[worker]->push(task);
+	} else {
+		std::lock_guard<std::mutex> lock(mutex);
+		injected.append(task);
+		num_injected.fetch_add(1, std::memory_order_relaxed);
+	}
+	signal(this, false);
+}
+
+void TaskGroup::wait()
+{
+	Scheduler *s = scheduler;
+	const int worker = s->current_worker();
+	while (pending.load(std::memory_order_acquire) != 0) {
+		const uint64_t e = s->epoch.load();
+		if (Task *t = find_task(s, worker)) {
+			run_task(s, t);
+			continue;
+		}
+		sleep(s, e, [this] { return pending.load(std::memory_order_acquire) == 0; });
+	}
+}
+
+Scheduler *default_scheduler()
+{
+	// the waiting thread makes up for the missing worker, never destroyed
+	// as threads may still use it while static objects go away
+	static Scheduler *scheduler = new Scheduler(
+		std::max(2U, std::thread::hardware_concurrency()) - 1);
+	return scheduler;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include "Core/Utils.h"
+#include "Core/Vector.h"
+
+struct Scheduler;
+struct TaskGroup;
+struct TaskDeque;
+
+// Scheduler shared by everything in the process, one worker per hardware
+// thread but one (the thread waiting for the tasks helps running them), one
+// at least. Created by the first call.
+Scheduler *default_scheduler();
+
+// A unit of work, 'execute' runs the task and frees it.
+struct Task {
+	void (*execute)(Task *task) = nullptr;
+	TaskGroup *group = nullptr;
+};
+
+template <typename F>
+struct FunctionTask : Task {
+	F f;
+
+	explicit FunctionTask(F &&f): f(std::move(f)) {}
+	explicit FunctionTask(const F &f): f(f) {}
+};
+
+// Tasks which are waited for together. Tasks may run more tasks in the same
+// group or in groups of their own.
+struct TaskGroup {
+	Scheduler *scheduler;
+
+	// run and not finished yet
+	std::atomic<int> pending;
+
+	NG_DELETE_COPY_AND_MOVE(TaskGroup);
+
+	explicit TaskGroup(Scheduler *scheduler = default_scheduler()):
+		scheduler(scheduler), pending(0)
+	{
+	}
+
+	// waits for the tasks, a group can't go away while they're running
+	~TaskGroup() { wait(); }
+
+	// Runs a copy of 'f' on one of the threads of the scheduler, or on the
+	// one calling wait().
+	template <typename F>
+	void run(F &&f);
+
+	// Runs tasks, of this group or not, until the group's are all done.
+	void wait();
+};
+
+// Fixed pool of worker threads. Every worker owns a Chase-Lev deque: it
+// pushes and pops tasks at the bottom of its own, idle workers steal them
+// from the top of the others'. Tasks run by threads which aren't workers go
+// into a shared queue. Idle workers sleep until a task comes.
+struct Scheduler {
+	Vector<std::thread> threads;
+	Vector<TaskDeque*> deques;
+
+	// tasks from threads which aren't workers, [injected_head, length) are
+	// waiting
+	std::mutex mutex;
+	Vector<Task*> injected;
+	int injected_head = 0;
+	std::atomic<int> num_injected;
+
+	// bumped when there's a new task or a group is done, sleepers wait for
+	// it to change
+	std::atomic<uint64_t> epoch;
+	std::atomic<int> sleepers;
+	std::condition_variable wake;
+	bool quit = false;
+
+	NG_DELETE_COPY_AND_MOVE(Scheduler);
+
+	// 'num_threads' workers, 0 means one per hardware thread. With
+	// 'pin_threads' worker i is bound to core i (where supported).
+	explicit Scheduler(int num_threads = 0, bool pin_threads = false);
+
+	// waits for the tasks to finish
+	~Scheduler();
+
+	int num_workers() const { return threads.length(); }
+
+	// Index of the calling thread among the workers, -1 if it isn't one.
+	int current_worker() const;
+
+	void submit(Task *task);
+};
+
+template <typename F>
+void TaskGroup::run(F &&f)
+{
+	using Function = typename std::decay<F>::type;
+	FunctionTask<Function> *task = new FunctionTask<Function>(std::forward<F>(f));
+	task->execute = [](Task *task) {
+		FunctionTask<Function> *t = static_cast<FunctionTask<Function>*>(task);
+		t->f();
+		delete t;
+	};
+	task->group = this;
+	pending.fetch_add(1, std::memory_order_relaxed);
+	scheduler->submit(task);
+}
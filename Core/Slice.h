@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <cstring>
 #include <initializer_list>
 #include <algorithm>
@@ -7,35 +8,35 @@
 
 #define _COMMON_SLICE_PART_CONST(T)                                         \
 	const T *data;                                                          \
-	int length;                                                             \
+	int64_t length;                                                         \
                                                                             \
 	Slice() = default;                                                      \
 	Slice(std::initializer_list<T> r): data(r.begin()), length(r.size()) {} \
 	template <int N>                                                        \
 	Slice(const T (&array)[N]): data(array), length(N) {}                   \
-	Slice(const T *data, int len): data(data), length(len) {}               \
+	Slice(const T *data, int64_t len): data(data), length(len) {}           \
 	Slice(const Slice<T> &r): data(r.data), length(r.length) {}             \
 	explicit operator bool() const { return length != 0; }                  \
-	int byte_length() const { return length * sizeof(T); }                  \
+	int64_t byte_length() const { return length * sizeof(T); }              \
 	const T &first() const { NG_ASSERT(length != 0); return data[0]; }      \
 	const T &last() const { NG_ASSERT(length != 0); return data[length-1]; }\
 	Slice<const T> sub() const                                              \
 	{                                                                       \
 		return {data, length};                                              \
 	}                                                                       \
-	Slice<const T> sub(int begin) const                                     \
+	Slice<const T> sub(int64_t begin) const                                 \
 	{                                                                       \
 		NG_SLICE_BOUNDS_CHECK(begin, length);                               \
 		return {data + begin, length - begin};                              \
 	}                                                                       \
-	Slice<const T> sub(int begin, int end) const                            \
+	Slice<const T> sub(int64_t begin, int64_t end) const                    \
 	{                                                                       \
 		NG_ASSERT(begin <= end);                                            \
 		NG_SLICE_BOUNDS_CHECK(begin, length);                               \
 		NG_SLICE_BOUNDS_CHECK(end, length);                                 \
 		return {data + begin, end - begin};                                 \
 	}                                                                       \
-	const T &operator[](int idx) const                                      \
+	const T &operator[](int64_t idx) const                                  \
 	{                                                                       \
 		NG_IDX_BOUNDS_CHECK(idx, length);                                   \
 		return data[idx];                                                   \
@@ -44,29 +45,29 @@
 template <typename T>
 struct Slice {
 	T *data;
-	int length;
+	int64_t length;
 
 	Slice() = default;
 
 	template <int N>
 	Slice(T (&array)[N]): data(array), length(N) {}
-	Slice(T *data, int length): data(data), length(length) {}
+	Slice(T *data, int64_t length): data(data), length(length) {}
 	explicit operator bool() const { return length != 0; }
 
-	T &operator[](int idx)
+	T &operator[](int64_t idx)
 	{
 		NG_IDX_BOUNDS_CHECK(idx, length);
 		return data[idx];
 	}
 
-	const T &operator[](int idx) const
+	const T &operator[](int64_t idx) const
 	{
 		NG_IDX_BOUNDS_CHECK(idx, length);
 		return data[idx];
 	}
 
 	// for consistency with Vector, but feel free to use length directly
-	int byte_length() const { return length * sizeof(T); }
+	int64_t byte_length() const { return length * sizeof(T); }
 
 	T &first() { NG_ASSERT(length != 0); return data[0]; }
 	const T &first() const { NG_ASSERT(length != 0); return data[0]; }
@@ -77,12 +78,12 @@ struct Slice {
 	{
 		return {data, length};
 	}
-	Slice sub(int begin)
+	Slice sub(int64_t begin)
 	{
 		NG_SLICE_BOUNDS_CHECK(begin, length);
 		return {data + begin, length - begin};
 	}
-	Slice sub(int begin, int end)
+	Slice sub(int64_t begin, int64_t end)
 	{
 		NG_ASSERT(begin <= end);
 		NG_SLICE_BOUNDS_CHECK(begin, length);
@@ -93,12 +94,12 @@ struct Slice {
 	{
 		return {data, length};
 	}
-	Slice<const T> sub(int begin) const
+	Slice<const T> sub(int64_t begin) const
 	{
 		NG_SLICE_BOUNDS_CHECK(begin, length);
 		return {data + begin, length - begin};
 	}
-	Slice<const T> sub(int begin, int end) const
+	Slice<const T> sub(int64_t begin, int64_t end) const
 	{
 		NG_ASSERT(begin <= end);
 		NG_SLICE_BOUNDS_CHECK(begin, length);
@@ -125,7 +126,7 @@ bool operator==(Slice<T> lhs, Slice<U> rhs)
 {
 	if (lhs.length != rhs.length)
 		return false;
-	for (int i = 0; i < lhs.length; i++) {
+	for (int64_t i = 0; i < lhs.length; i++) {
 		if (!(lhs.data[i] == rhs.data[i]))
 			return false;
 	}
@@ -135,7 +136,7 @@ bool operator==(Slice<T> lhs, Slice<U> rhs)
 template <typename T, typename U>
 bool operator<(Slice<T> lhs, Slice<U> rhs)
 {
-	for (int i = 0; i < rhs.length; i++) {
+	for (int64_t i = 0; i < rhs.length; i++) {
 		if (i == lhs.length) {
 			// lhs.len() < rhs.len(), but the common part is ==
 			return true;
@@ -191,9 +192,9 @@ template <typename T>
 T *end(Slice<T> s) { return s.data + s.length; }
 
 template <typename T, typename U>
-int copy(Slice<T> dst, Slice<U> src)
+int64_t copy(Slice<T> dst, Slice<U> src)
 {
-	const int n = std::min(dst.length, src.length);
+	const int64_t n = std::min(dst.length, src.length);
 	if (n == 0) {
 		return 0;
 	}
@@ -205,11 +206,11 @@ int copy(Slice<T> dst, Slice<U> src)
 	}
 
 	if (srcp < dstp) {
-		for (int i = n-1; i >= 0; i--) {
+		for (int64_t i = n-1; i >= 0; i--) {
 			dstp[i] = srcp[i];
 		}
 	} else {
-		for (int i = 0; i < n; i++) {
+		for (int64_t i = 0; i < n; i++) {
 			dstp[i] = srcp[i];
 		}
 	}
@@ -248,9 +249,9 @@ void sort(Slice<T> s, F &&f)
 template <typename T>
 void reverse(Slice<T> s)
 {
-	const int len1 = s.length - 1;
-	const int mid = s.length / 2;
-	for (int i = 0; i < mid; i++) {
+	const int64_t len1 = s.length - 1;
+	const int64_t mid = s.length / 2;
+	for (int64_t i = 0; i < mid; i++) {
 		std::swap(s[i], s[len1-i]);
 	}
 }
@@ -258,14 +259,14 @@ void reverse(Slice<T> s)
 template <typename T>
 void fill(Slice<T> s, const T &v)
 {
-	for (int i = 0; i < s.length; i++)
+	for (int64_t i = 0; i < s.length; i++)
 		s.data[i] = v;
 }
 
 template <typename T, typename U>
-int linear_find(Slice<T> s, const U &v)
+int64_t linear_find(Slice<T> s, const U &v)
 {
-	for (int i = 0; i < s.length; i++) {
+	for (int64_t i = 0; i < s.length; i++) {
 		if (s.data[i] == v)
 			return i;
 	}
@@ -273,23 +274,23 @@ int linear_find(Slice<T> s, const U &v)
 }
 
 template <typename T, typename F>
-int linear_find_if(Slice<T> s, F &&f)
+int64_t linear_find_if(Slice<T> s, F &&f)
 {
-	for (int i = 0; i < s.length; i++)
+	for (int64_t i = 0; i < s.length; i++)
 		if (f(s.data[i]))
 			return i;
 	return -1;
 }
 
 template <typename T, typename U>
-int binary_find(Slice<T> s, const U &v)
+int64_t binary_find(Slice<T> s, const U &v)
 {
-	int imax = s.length-1;
-	int imin = 0;
+	int64_t imax = s.length-1;
+	int64_t imin = 0;
 
 	while (imin < imax) {
 		// believe it or not, nobody really cares about overflows here
-		const int imid = (imin + imax) / 2;
+		const int64_t imid = (imin + imax) / 2;
 		if (s.data[imid] < v)
 			imin = imid+1;
 		else
@@ -25,11 +25,12 @@ void assertion_abort(const char *assertion, const char *file,
 	#define NG_ASSERT(expr) ((void)0)
 #endif
 
+// a negative index wraps around to a huge unsigned one
 #define NG_SLICE_BOUNDS_CHECK(index, length) \
-	NG_ASSERT((unsigned)(index) <= (unsigned)(length))
+	NG_ASSERT((unsigned long long)(index) <= (unsigned long long)(length))
 
 #define NG_IDX_BOUNDS_CHECK(index, length) \
-	NG_ASSERT((unsigned)(index) < (unsigned)(length))
+	NG_ASSERT((unsigned long long)(index) < (unsigned long long)(length))
 
 void die(const char *msg, ...);
 void warn(const char *msg, ...);
@@ -4,30 +4,57 @@
 #include "Core/Memory.h"
 #include "Core/Slice.h"
 
-template <typename T>
-struct Vector {
+// A dynamic array. The memory comes from 'Alloc' (see the allocator policies
+// in Memory.h), which the vector inherits, so that a stateless one takes no
+// space.
+template <typename T, typename Alloc = HeapAllocator>
+struct Vector : private Alloc {
 	T *m_data = nullptr;
-	int m_len = 0;
-	int m_cap = 0;
+	int64_t m_len = 0;
+	int64_t m_cap = 0;
+
+	T *_allocate(int64_t n)
+	{
+		return (T*)Alloc::allocate(sizeof(T) * n, alignof(T));
+	}
+
+	void _free(T *ptr)
+	{
+		if (ptr)
+			Alloc::free(ptr);
+	}
+
+	// objects which can be moved around with memcpy/realloc
+	static constexpr bool _relocatable = IsTriviallyRelocatable<T>::value;
 
-	int _new_size(int requested) const
+	// Moves the memory to an allocation of 'n' elements, 'n' >= m_len > 0.
+	void _reallocate(int64_t n)
 	{
-		int newcap = m_cap * 2;
+		m_data = (T*)Alloc::reallocate(m_data, sizeof(T) * m_len, sizeof(T) * n, alignof(T));
+	}
+
+	int64_t _new_size(int64_t requested) const
+	{
+		int64_t newcap = m_cap * 2;
 		return newcap < requested ? requested : newcap;
 	}
 
-	void _ensure_capacity(int n)
+	void _ensure_capacity(int64_t n)
 	{
 		if (m_len + n > m_cap)
 			reserve(_new_size(m_len + n));
 	}
 
 	// expects: idx < _len, idx >= 0, offset > 0
-	void _move_forward(int idx, int offset)
+	void _move_forward(int64_t idx, int64_t offset)
 	{
-		const int last = m_len-1;
-		int src = last;
-		int dst = last+offset;
+		if (_relocatable) {
+			copy_memory(m_data + idx + offset, m_data + idx, m_len - idx);
+			return;
+		}
+		const int64_t last = m_len-1;
+		int64_t src = last;
+		int64_t dst = last+offset;
 		while (src >= idx) {
 			new (&m_data[dst]) T(std::move(m_data[src]));
 			m_data[src].~T();
@@ -37,10 +64,14 @@ struct Vector {
 	}
 
 	// expects: idx < _len, idx >= 0, offset < 0
-	void _move_backward(int idx, int offset)
+	void _move_backward(int64_t idx, int64_t offset)
 	{
-		int src = idx;
-		int dst = idx+offset;
+		if (_relocatable) {
+			copy_memory(m_data + idx + offset, m_data + idx, m_len - idx);
+			return;
+		}
+		int64_t src = idx;
+		int64_t dst = idx+offset;
 		while (src < m_len) {
 			new (&m_data[dst]) T(std::move(m_data[src]));
 			m_data[src].~T();
@@ -49,9 +80,9 @@ struct Vector {
 		}
 	}
 
-	void _self_insert(int idx, Slice<const T> s)
+	void _self_insert(int64_t idx, Slice<const T> s)
 	{
-		int sidx = s.data - m_data;
+		int64_t sidx = s.data - m_data;
 		_ensure_capacity(s.length);
 
 		// restore the slice after possible realloc
@@ -59,7 +90,7 @@ struct Vector {
 
 		// shorcut case, append
 		if (idx == m_len) {
-			for (int i = 0; i < s.length; i++)
+			for (int64_t i = 0; i < s.length; i++)
 				new (m_data + idx + i) T(s.data[i]);
 			m_len += s.length;
 			return;
@@ -75,14 +106,13 @@ struct Vector {
 		if (idx <= sidx) {
 			s = Slice<const T>(s.data + s.length, s.length);
 		} else {
-			const int lhslen = idx - sidx;
-			copy_memory(m_data + idx, m_data + sidx, lhslen);
-			for (int i = 0; i < lhslen; i++)
+			const int64_t lhslen = std::min(idx - sidx, s.length);
+			for (int64_t i = 0; i < lhslen; i++)
 				new (m_data + idx + i) T(m_data[sidx+i]);
 			idx += lhslen;
 			s = Slice<const T>(s.data + s.length + lhslen, s.length - lhslen);
 		}
-		for (int i = 0; i < s.length; i++)
+		for (int64_t i = 0; i < s.length; i++)
 			new (m_data + idx + i) T(s.data[i]);
 	}
 
@@ -95,32 +125,36 @@ struct Vector {
 
 	Vector() = default;
 
-	explicit Vector(int n): m_len(n), m_cap(n)
+	explicit Vector(const Alloc &alloc): Alloc(alloc) {}
+
+	explicit Vector(int64_t n, const Alloc &alloc = Alloc()): Alloc(alloc), m_len(n), m_cap(n)
 	{
 		NG_ASSERT(n >= 0);
 		if (m_len == 0)
 			return;
-		m_data = allocate_memory<T>(m_len);
-		for (int i = 0; i < m_len; i++)
+		m_data = _allocate(m_len);
+		for (int64_t i = 0; i < m_len; i++)
 			new (m_data + i) T;
 	}
 
-	Vector(int n, const T &elem): m_len(n), m_cap(n)
+	Vector(int64_t n, const T &elem, const Alloc &alloc = Alloc()):
+		Alloc(alloc), m_len(n), m_cap(n)
 	{
 		NG_ASSERT(n >= 0);
 		if (m_len == 0)
 			return;
-		m_data = allocate_memory<T>(m_len);
-		for (int i = 0; i < m_len; i++)
+		m_data = _allocate(m_len);
+		for (int64_t i = 0; i < m_len; i++)
 			new (m_data + i) T(elem);
 	}
 
-	Vector(Slice<const T> s): m_len(s.length), m_cap(s.length)
+	Vector(Slice<const T> s, const Alloc &alloc = Alloc()):
+		Alloc(alloc), m_len(s.length), m_cap(s.length)
 	{
 		if (m_len == 0)
 			return;
-		m_data = allocate_memory<T>(m_len);
-		for (int i = 0; i < m_len; i++)
+		m_data = _allocate(m_len);
+		for (int64_t i = 0; i < m_len; i++)
 			new (m_data + i) T(s.data[i]);
 	}
 
@@ -134,7 +168,7 @@ struct Vector {
 
 	Vector(const Vector &r) = delete;
 
-	Vector(Vector &&r): m_data(r.m_data), m_len(r.m_len), m_cap(r.m_cap)
+	Vector(Vector &&r): Alloc(r.allocator()), m_data(r.m_data), m_len(r.m_len), m_cap(r.m_cap)
 	{
 		r._nullify();
 	}
@@ -149,16 +183,16 @@ struct Vector {
 			// slice is bigger than we are, realloc needed, also it
 			// means slice cannot point to ourselves and it is save
 			// to destroy ourselves
-			for (int i = 0; i < m_len; i++)
+			for (int64_t i = 0; i < m_len; i++)
 				m_data[i].~T();
-			free_memory(m_data);
+			_free(m_data);
 			m_cap = m_len = r.length;
-			m_data = allocate_memory<T>(m_len);
-			for (int i = 0; i < m_len; i++)
+			m_data = _allocate(m_len);
+			for (int64_t i = 0; i < m_len; i++)
 				new (m_data + i) T(r.data[i]);
 		} else {
 			// slice can be a subset of ourselves
-			int i = copy(sub(), r);
+			int64_t i = copy(sub(), r);
 			for (; i < m_len; i++) {
 				// destroy the rest if any
 				m_data[i].~T();
@@ -181,10 +215,12 @@ struct Vector {
 
 	Vector &operator=(Vector &&r)
 	{
-		for (int i = 0; i < m_len; i++)
+		for (int64_t i = 0; i < m_len; i++)
 			m_data[i].~T();
-		free_memory(m_data);
+		_free(m_data);
 
+		// the memory goes with the allocator it came from
+		allocator() = r.allocator();
 		m_data = r.m_data;
 		m_len = r.m_len;
 		m_cap = r.m_cap;
@@ -199,37 +235,46 @@ struct Vector {
 
 	~Vector()
 	{
-		for (int i = 0; i < m_len; i++)
+		for (int64_t i = 0; i < m_len; i++)
 			m_data[i].~T();
-		free_memory(m_data);
+		_free(m_data);
 	}
 
-	int length() const { return m_len; }
-	int byte_length() const { return m_len * sizeof(T); }
-	int capacity() const { return m_cap; }
+	Alloc &allocator() { return *this; }
+	const Alloc &allocator() const { return *this; }
+
+	int64_t length() const { return m_len; }
+	int64_t byte_length() const { return m_len * sizeof(T); }
+	int64_t capacity() const { return m_cap; }
 	T *data() { return m_data; }
 	const T *data() const { return m_data; }
 
 	void clear()
 	{
-		for (int i = 0; i < m_len; i++)
+		for (int64_t i = 0; i < m_len; i++)
 			m_data[i].~T();
 		m_len = 0;
 	}
 
-	void reserve(int n)
+	void reserve(int64_t n)
 	{
 		if (m_cap >= n)
 			return;
 
+		if (_relocatable && m_len > 0) {
+			_reallocate(n);
+			m_cap = n;
+			return;
+		}
+
 		T *old_data = m_data;
 		m_cap = n;
-		m_data = allocate_memory<T>(m_cap);
-		for (int i = 0; i < m_len; i++) {
+		m_data = _allocate(m_cap);
+		for (int64_t i = 0; i < m_len; i++) {
 			new (m_data + i) T(std::move(old_data[i]));
 			old_data[i].~T();
 		}
-		free_memory(old_data);
+		_free(old_data);
 	}
 
 	void shrink()
@@ -237,21 +282,27 @@ struct Vector {
 		if (m_cap == m_len)
 			return;
 
+		if (_relocatable && m_len > 0) {
+			_reallocate(m_len);
+			m_cap = m_len;
+			return;
+		}
+
 		T *old_data = m_data;
 		m_cap = m_len;
 		if (m_len > 0) {
-			m_data = allocate_memory<T>(m_len);
-			for (int i = 0; i < m_len; i++) {
+			m_data = _allocate(m_len);
+			for (int64_t i = 0; i < m_len; i++) {
 				new (m_data + i) T(std::move(old_data[i]));
 				old_data[i].~T();
 			}
 		} else {
 			m_data = nullptr;
 		}
-		free_memory(old_data);
+		_free(old_data);
 	}
 
-	void resize(int n)
+	void resize(int64_t n)
 	{
 		NG_ASSERT(n >= 0);
 
@@ -259,19 +310,19 @@ struct Vector {
 			return;
 
 		if (m_len > n) {
-			for (int i = n; i < m_len; i++)
+			for (int64_t i = n; i < m_len; i++)
 				m_data[i].~T();
 			m_len = n;
 			return;
 		}
 
 		reserve(n);
-		for (int i = m_len; i < n; i++)
+		for (int64_t i = m_len; i < n; i++)
 			new (m_data + i) T;
 		m_len = n;
 	}
 
-	void resize(int n, const T &elem)
+	void resize(int64_t n, const T &elem)
 	{
 		NG_ASSERT(n >= 0);
 
@@ -279,19 +330,19 @@ struct Vector {
 			return;
 
 		if (m_len > n) {
-			for (int i = n; i < m_len; i++)
+			for (int64_t i = n; i < m_len; i++)
 				m_data[i].~T();
 			m_len = n;
 			return;
 		}
 
 		reserve(n);
-		for (int i = m_len; i < n; i++)
+		for (int64_t i = m_len; i < n; i++)
 			new (m_data + i) T(elem);
 		m_len = n;
 	}
 
-	void quick_remove(int idx)
+	void quick_remove(int64_t idx)
 	{
 		NG_IDX_BOUNDS_CHECK(idx, m_len);
 		if (idx != m_len-1)
@@ -299,7 +350,7 @@ struct Vector {
 		m_data[--m_len].~T();
 	}
 
-	void remove(int idx)
+	void remove(int64_t idx)
 	{
 		NG_IDX_BOUNDS_CHECK(idx, m_len);
 		if (idx == m_len - 1) {
@@ -312,15 +363,15 @@ struct Vector {
 		m_len--;
 	}
 
-	void remove(int begin, int end)
+	void remove(int64_t begin, int64_t end)
 	{
 		NG_ASSERT(begin <= end);
 		NG_SLICE_BOUNDS_CHECK(begin, m_len);
 		NG_SLICE_BOUNDS_CHECK(end, m_len);
-		const int len = end - begin;
+		const int64_t len = end - begin;
 		if (len == 0)
 			return;
-		for (int i = begin; i < end; i++)
+		for (int64_t i = begin; i < end; i++)
 			m_data[i].~T();
 		if (end < m_len)
 			_move_backward(begin+len, -len);
@@ -328,7 +379,7 @@ struct Vector {
 	}
 
 	template <typename ...Args>
-	void pinsert(int idx, Args &&...args)
+	void pinsert(int64_t idx, Args &&...args)
 	{
 		NG_SLICE_BOUNDS_CHECK(idx, m_len);
 		_ensure_capacity(1);
@@ -339,17 +390,17 @@ struct Vector {
 		m_len++;
 	}
 
-	void insert(int idx, const T &elem)
+	void insert(int64_t idx, const T &elem)
 	{
 		pinsert(idx, elem);
 	}
 
-	void insert (int idx, T &&elem)
+	void insert (int64_t idx, T &&elem)
 	{
 		pinsert(idx, std::move(elem));
 	}
 
-	void insert(int idx, Slice<const T> s)
+	void insert(int64_t idx, Slice<const T> s)
 	{
 		NG_SLICE_BOUNDS_CHECK(idx, m_len);
 		if (s.length == 0) {
@@ -362,7 +413,7 @@ struct Vector {
 		_ensure_capacity(s.length);
 		if (idx < m_len)
 			_move_forward(idx, s.length);
-		for (int i = 0; i < s.length; i++)
+		for (int64_t i = 0; i < s.length; i++)
 			new (m_data + idx + i) T(s.data[i]);
 		m_len += s.length;
 	}
@@ -397,13 +448,13 @@ struct Vector {
 		insert(m_len, s);
 	}
 
-	T &operator[](int idx)
+	T &operator[](int64_t idx)
 	{
 		NG_IDX_BOUNDS_CHECK(idx, m_len);
 		return m_data[idx];
 	}
 
-	const T &operator[](int idx) const
+	const T &operator[](int64_t idx) const
 	{
 		NG_IDX_BOUNDS_CHECK(idx, m_len);
 		return m_data[idx];
@@ -418,12 +469,12 @@ struct Vector {
 	{
 		return {m_data, m_len};
 	}
-	Slice<T> sub(int begin)
+	Slice<T> sub(int64_t begin)
 	{
 		NG_SLICE_BOUNDS_CHECK(begin, m_len);
 		return {m_data + begin, m_len - begin};
 	}
-	Slice<T> sub(int begin, int end)
+	Slice<T> sub(int64_t begin, int64_t end)
 	{
 		NG_ASSERT(begin <= end);
 		NG_SLICE_BOUNDS_CHECK(begin, m_len);
@@ -434,12 +485,12 @@ struct Vector {
 	{
 		return {m_data, m_len};
 	}
-	Slice<const T> sub(int begin) const
+	Slice<const T> sub(int64_t begin) const
 	{
 		NG_SLICE_BOUNDS_CHECK(begin, m_len);
 		return {m_data + begin, m_len - begin};
 	}
-	Slice<const T> sub(int begin, int end) const
+	Slice<const T> sub(int64_t begin, int64_t end) const
 	{
 		NG_ASSERT(begin <= end);
 		NG_SLICE_BOUNDS_CHECK(begin, m_len);
@@ -451,11 +502,21 @@ struct Vector {
 	operator Slice<const T>() const { return {m_data, m_len}; }
 };
 
+// only points to memory of its own, which doesn't point back
+template <typename T, typename A>
+struct IsTriviallyRelocatable<Vector<T, A>> {
+	static constexpr bool value = true;
+};
+
+template <typename T, typename A>
+const T *begin(const Vector<T, A> &v) { return v.data(); }
+template <typename T, typename A>
+const T *end(const Vector<T, A> &v) { return v.data()+v.length(); }
+template <typename T, typename A>
+T *begin(Vector<T, A> &v) { return v.data(); }
+template <typename T, typename A>
+T *end(Vector<T, A> &v) { return v.data()+v.length(); }
+
+// A temporary in the scratch arena of the thread, see ScratchAllocator.
 template <typename T>
-const T *begin(const Vector<T> &v) { return v.data(); }
-template <typename T>
-const T *end(const Vector<T> &v) { return v.data()+v.length(); }
-template <typename T>
-T *begin(Vector<T> &v) { return v.data(); }
-template <typename T>
-T *end(Vector<T> &v) { return v.data()+v.length(); }
+using ScratchVector = Vector<T, ScratchAllocator>;
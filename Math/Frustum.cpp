@@ -0,0 +1,46 @@
+#include "Math/Frustum.h"
+#include "Math/Mat.h"
+
+// a * row(i) + b * row(3) of the matrix, as a normalized plane
+static Plane matrix_plane(const Mat4 &m, int i, float a)
+{
+	const Vec3f n(a * m[i] + m[3], a * m[4+i] + m[7], a * m[8+i] + m[11]);
+	const float d = a * m[12+i] + m[15];
+	const float inv_length = 1.0f / length(n);
+
+	Plane p;
+	p.n = n * Vec3f(inv_length);
+	p.d = d * inv_length;
+	return p;
+}
+
+Frustum::Frustum(const Transform &camera, float fov, float aspect, float znear, float zfar)
+{
+	// a point is inside if -w <= x, y, z <= w after the projection, each
+	// of these is a plane in the world space
+	const Mat4 m = Mat4_Perspective(fov, aspect, znear, zfar) *
+		to_mat4(inverse(camera));
+	planes[0] = matrix_plane(m, 0, 1);
+	planes[1] = matrix_plane(m, 0, -1);
+	planes[2] = matrix_plane(m, 1, 1);
+	planes[3] = matrix_plane(m, 1, -1);
+	planes[4] = matrix_plane(m, 2, 1);
+	planes[5] = matrix_plane(m, 2, -1);
+}
+
+void Frustum::cull(uint8_t *visible, const BoxesSoA &boxes) const
+{
+	const int n = boxes.count;
+	for (int i = 0; i < n; i++)
+		visible[i] = 1;
+
+	// a plane at a time, the loop over the boxes has no branches
+	for (const Plane &p : planes) {
+		// the corner of every box furthest along the normal
+		const float *x = p.far_corner_is_max(0) ? boxes.max_x : boxes.min_x;
+		const float *y = p.far_corner_is_max(1) ? boxes.max_y : boxes.min_y;
+		const float *z = p.far_corner_is_max(2) ? boxes.max_z : boxes.min_z;
+		for (int i = 0; i < n; i++)
+			visible[i] &= p.distance(x[i], y[i], z[i]) > 0.0f;
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include "Math/Vec.h"
+#include "Math/Plane.h"
+#include "Math/Transform.h"
+
+// Axis aligned boxes as separate arrays of coordinates, one array per
+// coordinate, so that many of them can be tested against a plane at once.
+struct BoxesSoA {
+	const float *min_x;
+	const float *min_y;
+	const float *min_z;
+	const float *max_x;
+	const float *max_y;
+	const float *max_z;
+	int count;
+};
+
+// The volume seen by a perspective camera, as six planes with the normals
+// pointing inside.
+struct Frustum {
+	// left, right, bottom, top, near, far
+	Plane planes[6];
+
+	Frustum() = default;
+
+	// A camera looking down the -Z axis of the transform, with the projection
+	// of gluPerspective(fov, aspect, znear, zfar), fov in degrees.
+	Frustum(const Transform &camera, float fov, float aspect, float znear, float zfar);
+
+	// Sets 'visible[i]' to 0 if box 'i' is behind one of the planes
+	// (Plane::side() would be PS_BACK), to 1 otherwise. Conservative: a box
+	// near a corner of the frustum may be outside of it and still pass.
+	void cull(uint8_t *visible, const BoxesSoA &boxes) const;
+};
@@ -0,0 +1,36 @@
+#include "Math/Pack.h"
+
+static inline float sign_not_zero(float v)
+{
+	return v < 0.0f ? -1.0f : 1.0f;
+}
+
+Vec2s encode_octahedral(const Vec3f &n)
+{
+	const float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+	// zero or NaN, there's no direction to keep
+	if (!(l1 > 0.0f))
+		return Vec2s(0, 0);
+
+	float x = n.x / l1;
+	float y = n.y / l1;
+	if (n.z < 0.0f) {
+		const float fx = (1.0f - std::fabs(y)) * sign_not_zero(x);
+		const float fy = (1.0f - std::fabs(x)) * sign_not_zero(y);
+		x = fx;
+		y = fy;
+	}
+	return Vec2s(encode_snorm16(x), encode_snorm16(y));
+}
+
+Vec3f decode_octahedral(const Vec2s &e)
+{
+	const float x = decode_snorm16(e.x);
+	const float y = decode_snorm16(e.y);
+	Vec3f n(x, y, 1.0f - std::fabs(x) - std::fabs(y));
+	if (n.z < 0.0f) {
+		n.x = (1.0f - std::fabs(y)) * sign_not_zero(x);
+		n.y = (1.0f - std::fabs(x)) * sign_not_zero(y);
+	}
+	return normalize(n);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include "Math/Vec.h"
+
+//------------------------------------------------------------------------------
+// Compact encodings of vectors, for vertex data
+//------------------------------------------------------------------------------
+
+// [0, 1] <-> [0, 65535], rounds to nearest and clamps
+static inline uint16_t encode_unorm16(float v)
+{
+	return clamp(v, 0.0f, 1.0f) * 65535.0f + 0.5f;
+}
+
+static inline float decode_unorm16(uint16_t v)
+{
+	return v * (1.0f / 65535.0f);
+}
+
+// [-1, 1] <-> [-32767, 32767], rounds to nearest and clamps
+static inline int16_t encode_snorm16(float v)
+{
+	return std::lround(clamp(v, -1.0f, 1.0f) * 32767.0f);
+}
+
+static inline float decode_snorm16(int16_t v)
+{
+	return max(v * (1.0f / 32767.0f), -1.0f);
+}
+
+// Octahedral encoding of unit vectors: the vector is projected onto the
+// octahedron |x| + |y| + |z| = 1, the lower half of which is folded over the
+// upper one to fill a square, and the square is stored as two snorm16s. The
+// error is below 0.005 degrees everywhere.
+Vec2s encode_octahedral(const Vec3f &n);
+
+// returns a normalized vector
+Vec3f decode_octahedral(const Vec2s &e);
@@ -10,28 +10,17 @@ PlaneSide Plane::side(const Vec3f &point) const
 
 PlaneSide Plane::side(const Vec3f &min, const Vec3f &max) const
 {
-	Vec3f near(max);
-	Vec3f far(min);
-
-	if (n.x > 0) {
-		near.x = min.x;
-		far.x = max.x;
-	}
-
-	if (n.y > 0) {
-		near.y = min.y;
-		far.y = max.y;
-	}
-
-	if (n.z > 0) {
-		near.z = min.z;
-		far.z = max.z;
+	Vec3f near, far;
+	for (int i = 0; i < 3; i++) {
+		const bool far_max = far_corner_is_max(i);
+		near[i] = far_max ? min[i] : max[i];
+		far[i] = far_max ? max[i] : min[i];
 	}
 
-	if (dot(n, near) + d > 0)
+	if (distance(near.x, near.y, near.z) > 0)
 		return PS_FRONT;
 
-	if (dot(n, far) + d > 0)
+	if (distance(far.x, far.y, far.z) > 0)
 		return PS_BOTH;
 
 	return PS_BACK;
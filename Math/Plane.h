@@ -25,6 +25,13 @@ struct Plane {
 	PlaneSide side(const Vec3f &point) const;
 	PlaneSide side(const Vec3f &min, const Vec3f &max) const;
 
+	// Whether the corner of an axis aligned box furthest along the normal is
+	// on the max side of the box on 'axis', the nearest corner is opposite.
+	bool far_corner_is_max(int axis) const { return n[axis] > 0; }
+
+	// positive in front of the plane
+	float distance(float x, float y, float z) const { return n.x * x + n.y * y + n.z * z + d; }
+
 	Vec3f n;
 	float d;
 };
@@ -110,6 +110,7 @@ static inline Vec2i ToVec2i(const Vec2f &v) { return Vec2i(v.x, v.y); }
 
 
 #define _DEFINE_VEC3_INT_FUNCTIONS(type, Vec3)                                                                                             \
+static inline int64_t volume(const Vec3 &v) { return int64_t(v.x) * v.y * v.z; }                                                           \
 static inline Vec3 floor_div(const Vec3 &a, const Vec3 &b) { return Vec3(floor_div(a.x, b.x), floor_div(a.y, b.y), floor_div(a.z, b.z)); } \
 static inline Vec3 operator^(const Vec3 &l, const Vec3 &r) { return Vec3(l.x ^ r.x, l.y ^ r.y, l.z ^ r.z); }                               \
 static inline Vec3 operator%(const Vec3 &l, const Vec3 &r) { return Vec3(l.x % r.x, l.y % r.y, l.z % r.z); }                               \
@@ -119,6 +120,7 @@ static inline Vec3 operator~(const Vec3 &v) { return Vec3(~v.x, ~v.y, ~v.z); }
 
 
 #define _DEFINE_VEC3_FLOAT_FUNCTIONS(type, Vec3)                                                                                          \
+static inline type volume(const Vec3 &v) { return v.x * v.y * v.z; }                                                                      \
 static inline Vec3 abs(const Vec3 &v) { return Vec3(std::abs(v.x), std::abs(v.y), std::abs(v.z)); }                                       \
 static inline type length(const Vec3 &v) { return std::sqrt(length2(v)); }                                                                \
 static inline Vec3 normalize(const Vec3 &v) { return v / Vec3(length(v)); }                                                               \
@@ -177,7 +179,6 @@ static inline Vec3 operator-(const Vec3 &v) { return Vec3(-v.x, -v.y, -v.z); }
                                                                                                                                                            \
 static inline type length2(const Vec3 &v) { return v.x*v.x + v.y*v.y + v.z*v.z; }                                                                          \
 static inline type dot(const Vec3 &v1, const Vec3 &v2) { return v1.x*v2.x + v1.y*v2.y + v1.z*v2.z; }                                                       \
-static inline type volume(const Vec3 &v) { return v.x * v.y * v.z; }                                                                                       \
 static inline Vec3 cross(const Vec3 &v1, const Vec3 &v2) { return Vec3(v1.y * v2.z - v1.z * v2.y, v1.z * v2.x - v1.x * v2.z, v1.x * v2.y - v1.y * v2.x); } \
 static inline type distance2(const Vec3 &v1, const Vec3 &v2) { return length2(v2-v1); }                                                                    \
 static inline Vec3 min(const Vec3 &v1, const Vec3 &v2) { return {min(v1.x, v2.x), min(v1.y, v2.y), min(v1.z, v2.z)}; }                                     \
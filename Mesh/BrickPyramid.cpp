@@ -0,0 +1,170 @@
+#include "Mesh/BrickPyramid.h"
+#include "Mesh/Mesher.h"
+#include <cfloat>
+
+template <typename T>
+static void compute_brick(MinMax *out, Slice<const T> voxels,
+	const Vec3i &size, const Vec3i &b)
+{
+	const Vec3i vmin = b * Vec3i(BrickPyramid::BRICK_SIZE);
+	const Vec3i vmax = min(vmin + Vec3i(BrickPyramid::BRICK_SIZE), size - Vec3i(1));
+	float lo = FLT_MAX;
+	float hi = -FLT_MAX;
+	for (int z = vmin.z; z <= vmax.z; z++) {
+	for (int y = vmin.y; y <= vmax.y; y++) {
+		const T *row = voxels.data + offset_3d({0, y, z}, size);
+		for (int x = vmin.x; x <= vmax.x; x++) {
+			const float v = decode_sample(row[x]);
+			lo = std::min(lo, v);
+			hi = std::max(hi, v);
+		}
+	}}
+	*out = {lo, hi};
+}
+
+static void compute_parent(BrickPyramidLevel *level, const BrickPyramidLevel &child,
+	const Vec3i &p)
+{
+	const Vec3i cmin = p * Vec3i(2);
+	const Vec3i cmax = min(cmin + Vec3i(1), child.size - Vec3i(1));
+	MinMax mm = {FLT_MAX, -FLT_MAX};
+	for (int z = cmin.z; z <= cmax.z; z++) {
+	for (int y = cmin.y; y <= cmax.y; y++) {
+	for (int x = cmin.x; x <= cmax.x; x++) {
+		const MinMax &c = child.at({x, y, z});
+		mm.min = std::min(mm.min, c.min);
+		mm.max = std::max(mm.max, c.max);
+	}}}
+	level->bricks[(p.z * level->size.y + p.y) * level->size.x + p.x] = mm;
+}
+
+// recomputes bricks [min, max] and the entries above them
+template <typename T>
+static void update_levels(BrickPyramid *pyramid, Slice<const T> voxels,
+	Vec3i min, Vec3i max)
+{
+	BrickPyramidLevel &base = pyramid->levels[0];
+	for (int z = min.z; z <= max.z; z++) {
+	for (int y = min.y; y <= max.y; y++) {
+	for (int x = min.x; x <= max.x; x++) {
+		const Vec3i b(x, y, z);
+		compute_brick(&base.bricks[(z * base.size.y + y) * base.size.x + x],
+			voxels, pyramid->size, b);
+	}}}
+
+	for (int l = 1; l < pyramid->levels.length(); l++) {
+		min = floor_div(min, Vec3i(2));
+		max = floor_div(max, Vec3i(2));
+		for (int z = min.z; z <= max.z; z++) {
+		for (int y = min.y; y <= max.y; y++) {
+		for (int x = min.x; x <= max.x; x++) {
+			compute_parent(&pyramid->levels[l], pyramid->levels[l-1], {x, y, z});
+		}}}
+	}
+}
+
+template <typename T>
+static void build_pyramid(BrickPyramid *pyramid, Slice<const T> voxels, const Vec3i &size)
+{
+	constexpr int BRICK_SIZE = BrickPyramid::BRICK_SIZE;
+	NG_ASSERT(voxels.length == volume(size));
+	NG_ASSERT(size >= Vec3i(2));
+	pyramid->size = size;
+	pyramid->levels.clear();
+
+	Vec3i lsize = (size - Vec3i(1) + Vec3i(BRICK_SIZE-1)) / Vec3i(BRICK_SIZE);
+	for (;;) {
+		BrickPyramidLevel *level = pyramid->levels.append();
+		level->size = lsize;
+		level->bricks.resize(volume(lsize));
+		if (lsize == Vec3i(1))
+			break;
+		lsize = (lsize + Vec3i(1)) / Vec3i(2);
+	}
+	update_levels(pyramid, voxels, Vec3i(0), pyramid->levels[0].size - Vec3i(1));
+}
+
+template <typename T>
+static void update_pyramid(BrickPyramid *pyramid, Slice<const T> voxels,
+	const Vec3i &min, const Vec3i &max)
+{
+	constexpr int BRICK_SIZE = BrickPyramid::BRICK_SIZE;
+	NG_ASSERT(voxels.length == volume(pyramid->size));
+	NG_ASSERT(min <= max);
+
+	// voxel v is shared by bricks (v-1)/BRICK_SIZE and v/BRICK_SIZE
+	const Vec3i bmin = ::max(floor_div(min - Vec3i(1), Vec3i(BRICK_SIZE)), Vec3i(0));
+	const Vec3i bmax = ::min(floor_div(max, Vec3i(BRICK_SIZE)), pyramid->levels[0].size - Vec3i(1));
+	if (!(bmin <= bmax))
+		return;
+	update_levels(pyramid, voxels, bmin, bmax);
+}
+
+template <typename T>
+static bool pyramid_matches(const BrickPyramid &pyramid, Slice<const T> voxels)
+{
+	BrickPyramid built;
+	build_pyramid(&built, voxels, pyramid.size);
+	if (built.levels.length() != pyramid.levels.length())
+		return false;
+	for (int l = 0; l < built.levels.length(); l++) {
+		const BrickPyramidLevel &a = built.levels[l];
+		const BrickPyramidLevel &b = pyramid.levels[l];
+		if (a.size != b.size)
+			return false;
+		for (int i = 0; i < a.bricks.length(); i++) {
+			if (a.bricks[i].min != b.bricks[i].min || a.bricks[i].max != b.bricks[i].max)
+				return false;
+		}
+	}
+	return true;
+}
+
+#define NG_PYRAMID_BUILDERS(T)                                                         \
+void BrickPyramid::build(Slice<const T> voxels, const Vec3i &size)                    \
+{                                                                                      \
+	build_pyramid(this, voxels, size);                                             \
+}                                                                                      \
+void BrickPyramid::update(Slice<const T> voxels, const Vec3i &min, const Vec3i &max)  \
+{                                                                                      \
+	update_pyramid(this, voxels, min, max);                                        \
+}                                                                                      \
+bool BrickPyramid::matches(Slice<const T> voxels) const                               \
+{                                                                                      \
+	return pyramid_matches(*this, voxels);                                         \
+}
+
+NG_PYRAMID_BUILDERS(float)
+NG_PYRAMID_BUILDERS(int8_t)
+NG_PYRAMID_BUILDERS(uint16_t)
+NG_PYRAMID_BUILDERS(Half)
+
+static bool active_r(const BrickPyramid &pyramid, int l, const Vec3i &p,
+	const Vec3i &bmin, const Vec3i &bmax)
+{
+	const BrickPyramidLevel &level = pyramid.levels[l];
+	if (!level.at(p).crosses())
+		return false;
+	if (l == 0)
+		return true;
+
+	// entries of the level below covered by this one and by the query
+	const int scale = 1 << (l-1);
+	const Vec3i cmin = max(p * Vec3i(2), floor_div(bmin, Vec3i(scale)));
+	const Vec3i cmax = min(min(p * Vec3i(2) + Vec3i(1), pyramid.levels[l-1].size - Vec3i(1)),
+		floor_div(bmax, Vec3i(scale)));
+	for (int z = cmin.z; z <= cmax.z; z++) {
+	for (int y = cmin.y; y <= cmax.y; y++) {
+	for (int x = cmin.x; x <= cmax.x; x++) {
+		if (active_r(pyramid, l-1, {x, y, z}, bmin, bmax))
+			return true;
+	}}}
+	return false;
+}
+
+bool BrickPyramid::active(const Vec3i &min, const Vec3i &max) const
+{
+	const Vec3i bmin = ::max(brick_of(min), Vec3i(0));
+	const Vec3i bmax = brick_of(max);
+	return active_r(*this, levels.length()-1, Vec3i(0), bmin, bmax);
+}
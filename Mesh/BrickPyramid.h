@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Core/Vector.h"
+#include "Math/Vec.h"
+#include "Mesh/Sample.h"
+
+struct MinMax {
+	float min;
+	float max;
+
+	// a cell can only have a surface crossing if some of its corners are
+	// inside (< 0) and some are not
+	bool crosses() const { return min < 0.0f && max >= 0.0f; }
+};
+
+struct BrickPyramidLevel {
+	Vector<MinMax> bricks;
+	Vec3i size;
+
+	const MinMax &at(const Vec3i &b) const
+	{
+		return bricks[(int64_t(b.z) * size.y + b.y) * size.x + b.x];
+	}
+};
+
+// Min/max of the voxels of every BRICK_SIZE^3 block of cells, level 0 is the
+// bricks themselves, every next level merges 2x2x2 entries of the level below
+// until there is a single entry left. Brick b covers cells [b*BRICK_SIZE,
+// (b+1)*BRICK_SIZE) which means voxels [b*BRICK_SIZE, (b+1)*BRICK_SIZE],
+// neighbouring bricks share a layer of voxels.
+struct BrickPyramid {
+	static constexpr int BRICK_SIZE = 8;
+
+	Vector<BrickPyramidLevel> levels;
+	Vec3i size = Vec3i(0);
+
+	// min/max are kept as decoded floats whatever the sample format is
+	void build(Slice<const float> voxels, const Vec3i &size);
+	void build(Slice<const int8_t> voxels, const Vec3i &size);
+	void build(Slice<const uint16_t> voxels, const Vec3i &size);
+	void build(Slice<const Half> voxels, const Vec3i &size);
+
+	// Recomputes everything that depends on voxels in [min, max] (inclusive),
+	// call it after modifying the volume.
+	void update(Slice<const float> voxels, const Vec3i &min, const Vec3i &max);
+	void update(Slice<const int8_t> voxels, const Vec3i &min, const Vec3i &max);
+	void update(Slice<const uint16_t> voxels, const Vec3i &min, const Vec3i &max);
+	void update(Slice<const Half> voxels, const Vec3i &min, const Vec3i &max);
+
+	// True if the pyramid is the one build() makes of the voxels, a check
+	// for the updates of a modified volume.
+	bool matches(Slice<const float> voxels) const;
+	bool matches(Slice<const int8_t> voxels) const;
+	bool matches(Slice<const uint16_t> voxels) const;
+	bool matches(Slice<const Half> voxels) const;
+
+	const MinMax &brick(const Vec3i &b) const { return levels[0].at(b); }
+
+	// brick containing the cell, or one of the bricks containing the voxel
+	Vec3i brick_of(const Vec3i &p) const
+	{
+		return min(floor_div(p, Vec3i(BRICK_SIZE)), levels[0].size - Vec3i(1));
+	}
+
+	// Returns true if any brick overlapping cells [min, max] (inclusive) may
+	// have a surface crossing, walks the pyramid from the top.
+	bool active(const Vec3i &min, const Vec3i &max) const;
+};
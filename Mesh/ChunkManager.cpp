@@ -0,0 +1,481 @@
+#include "Mesh/ChunkManager.h"
+#include "Mesh/MeshOptimizer.h"
+#include "Mesh/Simplify.h"
+#include <chrono>
+#include <cfloat>
+
+Vec3i Chunk::origin() const
+{
+	return coords * Vec3i(ChunkManager::CHUNK_SIZE);
+}
+
+int64_t Chunk::memory_usage() const
+{
+	int64_t pyramid_bricks = 0;
+	for (const BrickPyramidLevel &l : pyramid.levels)
+		pyramid_bricks += l.bricks.capacity();
+	return sizeof(Chunk) +
+		(int64_t)voxels.capacity() * sizeof(float) +
+		pyramid_bricks * sizeof(MinMax) +
+		(int64_t)mesh.vertices.capacity() * sizeof(Vertex) +
+		(int64_t)mesh.indices.capacity() * sizeof(int);
+}
+
+//----------------------------------------------------------------------------
+// LRU
+//----------------------------------------------------------------------------
+
+static void lru_push_front(ChunkManager *cm, Chunk *c)
+{
+	NG_ASSERT(c->lru_prev == nullptr && c->lru_next == nullptr);
+	c->lru_next = cm->lru_head;
+	if (cm->lru_head)
+		cm->lru_head->lru_prev = c;
+	else
+		cm->lru_tail = c;
+	cm->lru_head = c;
+	cm->cache_memory += c->memory_usage();
+}
+
+static void lru_remove(ChunkManager *cm, Chunk *c)
+{
+	if (c->lru_prev)
+		c->lru_prev->lru_next = c->lru_next;
+	else
+		cm->lru_head = c->lru_next;
+	if (c->lru_next)
+		c->lru_next->lru_prev = c->lru_prev;
+	else
+		cm->lru_tail = c->lru_prev;
+	c->lru_prev = c->lru_next = nullptr;
+	cm->cache_memory -= c->memory_usage();
+}
+
+static void evict(ChunkManager *cm)
+{
+	while (cm->cache_memory > cm->cache_memory_limit && cm->lru_tail) {
+		Chunk *c = cm->lru_tail;
+		lru_remove(cm, c);
+		cm->chunks.erase(c->coords);
+		delete c;
+	}
+}
+
+//----------------------------------------------------------------------------
+// ChunkManager
+//----------------------------------------------------------------------------
+
+ChunkManager::ChunkManager(int seed): terrain(seed)
+{
+	terrain.cave_amplitude = 0.1f;
+}
+
+ChunkManager::~ChunkManager()
+{
+	for (auto &kv : chunks)
+		delete kv.second;
+}
+
+Vec3i ChunkManager::chunk_of(const Vec3f &position)
+{
+	return floor(position / Vec3f(CHUNK_SIZE));
+}
+
+Chunk *ChunkManager::find(const Vec3i &coords) const
+{
+	auto it = chunks.find(coords);
+	return it != chunks.end() ? it->second : nullptr;
+}
+
+static int chunk_distance2(const ChunkManager &cm, const Vec3i &coords)
+{
+	return length2(coords - cm.center);
+}
+
+static bool in_view(const ChunkManager &cm, const Vec3i &coords)
+{
+	const Vec3i d = coords - cm.center;
+	return d.x*d.x + d.z*d.z <= cm.view_radius*cm.view_radius &&
+		std::abs(d.y) <= cm.vertical_radius;
+}
+
+// The horizontal distance of two chunks next to each other differs by one
+// chunk at most, so is their level, the rings being a chunk wide at least.
+static int chunk_lod(const ChunkManager &cm, const Vec3i &coords)
+{
+	const Vec3i d = coords - cm.center;
+	const int d2 = d.x*d.x + d.z*d.z;
+	const int r1 = cm.detail_radius;
+	const int r2 = cm.detail_radius + cm.lod_ring;
+	if (d2 <= r1*r1)
+		return 0;
+	if (d2 <= r2*r2)
+		return 1;
+	return ChunkManager::MAX_LOD;
+}
+
+static ChunkDetail wanted_detail(const ChunkManager &cm, const Vec3i &coords)
+{
+	NG_ASSERT(cm.lod_ring >= 1);
+	ChunkDetail detail;
+	const int lod = chunk_lod(cm, coords);
+	if (cm.mesh_type != MT_MARCHING_CUBES_SMOOTH) {
+		detail.simplified = lod > 0;
+		return detail;
+	}
+
+	detail.lod = lod;
+	for (int face = 0; face < 6; face++) {
+		Vec3i n = coords;
+		n[face / 2] += face & 1 ? 1 : -1;
+		if (chunk_lod(cm, n) < lod)
+			detail.transition_faces |= 1 << face;
+	}
+	return detail;
+}
+
+static void deactivate(ChunkManager *cm, Chunk *c)
+{
+	c->active = false;
+	if (!c->edited)
+		lru_push_front(cm, c);
+}
+
+// rebuilds the active and the pending lists after the camera moved to
+// another chunk
+static void refresh(ChunkManager *cm)
+{
+	int n = 0;
+	for (Chunk *c : cm->active) {
+		if (in_view(*cm, c->coords) && c->meshed)
+			cm->active[n++] = c;
+		else
+			deactivate(cm, c);
+	}
+	cm->active.resize(n);
+
+	cm->pending.clear();
+	const int r = cm->view_radius;
+	const int vr = cm->vertical_radius;
+	for (int z = -r; z <= r; z++) {
+	for (int y = -vr; y <= vr; y++) {
+	for (int x = -r; x <= r; x++) {
+		const Vec3i coords = cm->center + Vec3i(x, y, z);
+		if (!in_view(*cm, coords))
+			continue;
+
+		Chunk *c = cm->find(coords);
+		if (c && c->active) {
+			if (c->detail != wanted_detail(*cm, coords))
+				cm->pending.append(coords);
+			continue;
+		}
+		if (c && c->meshed) {
+			if (!c->edited)
+				lru_remove(cm, c);
+			c->active = true;
+			cm->active.append(c);
+			continue;
+		}
+		cm->pending.append(coords);
+	}}}
+
+	sort(cm->pending.sub(), [cm](const Vec3i &a, const Vec3i &b) {
+		return chunk_distance2(*cm, a) > chunk_distance2(*cm, b);
+	});
+
+	// chunks which just went out of view may push the cache over the limit
+	evict(cm);
+}
+
+// creates the chunk and generates its voxels, it is neither active nor cached
+static Chunk *generate_chunk(ChunkManager *cm, const Vec3i &coords)
+{
+	constexpr int N = ChunkManager::CHUNK_SIZE + 1;
+	Chunk *c = new (OrDie) Chunk;
+	c->coords = coords;
+	cm->chunks[coords] = c;
+
+	c->voxels.resize(N*N*N);
+	cm->terrain.generate(c->voxels, c->origin(), Vec3i(N));
+	c->bounds = {FLT_MAX, -FLT_MAX};
+	for (float v : c->voxels) {
+		c->bounds.min = std::min(c->bounds.min, v);
+		c->bounds.max = std::max(c->bounds.max, v);
+	}
+
+	// most of the chunks are entirely air or solid
+	if (!c->bounds.crosses())
+		c->voxels = Vector<float>();
+	else
+		c->pyramid.build(c->voxels, Vec3i(N));
+	return c;
+}
+
+// Meshes the voxels of a chunk into its empty mesh with the given detail.
+// Chunk meshes are drawn many times, so they're worth reordering for the
+// vertex cache, except flat shaded ones which share no vertices.
+static void mesh_chunk(ChunkManager *cm, Chunk *c, const ChunkDetail &detail)
+{
+	constexpr int N = ChunkManager::CHUNK_SIZE + 1;
+	c->detail = detail;
+	c->mesh_revision = ++cm->mesh_revisions;
+	if (!c->bounds.crosses())
+		return;
+
+	if (detail.lod > 0) {
+		generate_geometry_lod(&c->mesh, c->voxels, Vec3i(N), 1 << detail.lod,
+			detail.transition_faces, &cm->context);
+	} else {
+		generate_mesh(&c->mesh, cm->mesh_type, c->voxels, Vec3i(N), &c->pyramid,
+			&cm->context);
+	}
+	const bool flat = cm->mesh_type == MT_MARCHING_CUBES;
+	if (detail.simplified)
+		simplify_mesh(&c->mesh, c->mesh.indices.length() / 3 / cm->far_reduction, flat);
+	if (!flat)
+		optimize_mesh(&c->mesh);
+}
+
+static void produce(ChunkManager *cm, const Vec3i &coords)
+{
+	Chunk *c = cm->find(coords);
+	if (c && c->active) {
+		// its detail changed, it kept being drawn until now
+		const ChunkDetail detail = wanted_detail(*cm, coords);
+		if (c->detail == detail)
+			return;
+		c->mesh.clear();
+		mesh_chunk(cm, c, detail);
+		return;
+	}
+	if (c) {
+		// in the cache or edited, but without a mesh
+		if (!c->edited)
+			lru_remove(cm, c);
+	} else {
+		c = generate_chunk(cm, coords);
+	}
+
+	mesh_chunk(cm, c, wanted_detail(*cm, coords));
+	c->mesh.vertices.shrink();
+	c->mesh.indices.shrink();
+	c->meshed = true;
+	c->active = true;
+	cm->active.append(c);
+}
+
+void ChunkManager::update(const Vec3f &camera_position)
+{
+	remesh_dirty();
+
+	const Vec3i c = chunk_of(camera_position);
+	if (!center_valid || c != center) {
+		center = c;
+		center_valid = true;
+		refresh(this);
+	}
+
+	using clock = std::chrono::steady_clock;
+	const clock::time_point start = clock::now();
+	while (pending.length() > 0) {
+		const Vec3i coords = pending.last();
+		pending.remove(pending.length()-1);
+		produce(this, coords);
+
+		const std::chrono::duration<double, std::milli> spent = clock::now() - start;
+		if (spent.count() >= time_budget_ms)
+			break;
+	}
+}
+
+static void drop_meshes(ChunkManager *cm)
+{
+	for (auto &kv : cm->chunks) {
+		Chunk *c = kv.second;
+		const bool cached = !c->active && !c->edited;
+		if (cached)
+			cm->cache_memory -= c->memory_usage();
+		c->mesh = Mesh();
+		c->meshed = false;
+		if (cached)
+			cm->cache_memory += c->memory_usage();
+	}
+	cm->center_valid = false;
+}
+
+void ChunkManager::set_mesh_type(MeshType type)
+{
+	if (mesh_type == type)
+		return;
+
+	mesh_type = type;
+	drop_meshes(this);
+}
+
+// Edited chunks keep the terrain around their edits wide enough for gradient
+// normals in either mode (see editable_chunk), they're only remeshed.
+void ChunkManager::set_normal_mode(NormalMode mode)
+{
+	if (context.normals == mode)
+		return;
+
+	context.normals = mode;
+	drop_meshes(this);
+}
+
+//----------------------------------------------------------------------------
+// Editing
+//----------------------------------------------------------------------------
+
+void ChunkManager::chunks_of(Vec3i *cmin, Vec3i *cmax, const Vec3i &min, const Vec3i &max)
+{
+	NG_ASSERT(cmin != nullptr);
+	NG_ASSERT(cmax != nullptr);
+	// chunk c stores the voxels from c*CHUNK_SIZE to (c+1)*CHUNK_SIZE
+	*cmin = floor_div(min - Vec3i(1), Vec3i(CHUNK_SIZE));
+	*cmax = floor_div(max, Vec3i(CHUNK_SIZE));
+}
+
+static constexpr int GEN_BLOCK_SIZE = 8;
+static constexpr int GEN_BLOCKS = ChunkManager::CHUNK_SIZE / GEN_BLOCK_SIZE;
+static_assert(GEN_BLOCKS*GEN_BLOCKS*GEN_BLOCKS <= 64, "generated_blocks is too small");
+
+static int gen_block_of(int v)
+{
+	return std::min(v / GEN_BLOCK_SIZE, GEN_BLOCKS - 1);
+}
+
+// generates the blocks of the chunk overlapping the [lmin, lmax] voxels, which
+// aren't generated yet
+static void generate_blocks(ChunkManager *cm, Chunk *c, const Vec3i &lmin, const Vec3i &lmax)
+{
+	constexpr int N = ChunkManager::CHUNK_SIZE + 1;
+	constexpr int B = GEN_BLOCK_SIZE + 1;
+	float tmp[B*B*B];
+
+	for (int bz = gen_block_of(lmin.z); bz <= gen_block_of(lmax.z); bz++) {
+	for (int by = gen_block_of(lmin.y); by <= gen_block_of(lmax.y); by++) {
+	for (int bx = gen_block_of(lmin.x); bx <= gen_block_of(lmax.x); bx++) {
+		const uint64_t bit = uint64_t(1) << offset_3d(Vec3i(bx, by, bz), Vec3i(GEN_BLOCKS));
+		if (c->generated_blocks & bit)
+			continue;
+		c->generated_blocks |= bit;
+
+		const Vec3i b(bx, by, bz);
+		const Vec3i bmin = b * Vec3i(GEN_BLOCK_SIZE);
+		const Vec3i bmax = bmin + Vec3i(GEN_BLOCK_SIZE - 1) +
+			Vec3i(bx == GEN_BLOCKS-1, by == GEN_BLOCKS-1, bz == GEN_BLOCKS-1);
+		const Vec3i dims = bmax - bmin + Vec3i(1);
+		cm->terrain.generate(Slice<float>(tmp, volume(dims)), c->origin() + bmin, dims);
+		for (int z = 0; z < dims.z; z++) {
+		for (int y = 0; y < dims.y; y++) {
+			copy(Slice<float>(&c->voxels[offset_3d(bmin + Vec3i(0, y, z), Vec3i(N))], dims.x),
+				Slice<const float>(&tmp[offset_3d(Vec3i(0, y, z), dims)], dims.x));
+		}}
+		c->pyramid.update(c->voxels, bmin, bmax);
+	}}}
+}
+
+Chunk *ChunkManager::editable_chunk(const Vec3i &coords, const Vec3i &min, const Vec3i &max)
+{
+	constexpr int N = CHUNK_SIZE + 1;
+	Chunk *c = find(coords);
+	if (!c)
+		c = generate_chunk(this, coords);
+	else if (!c->edited && !c->active)
+		lru_remove(this, c);
+	c->edited = true;
+
+	// The voxels of a chunk without a crossing were dropped. Every cell
+	// with a crossing after the edit has a corner in the edited region, so
+	// only the voxels the meshers read for such a cell need the actual
+	// terrain, the rest are filled with a value of the same sign as the
+	// terrain. The reads are:
+	// - the corners of the cell, up to 1 << MAX_LOD voxels from an edited
+	//   one at the coarsest level
+	// - central differences around the ends of a crossing edge, one voxel
+	//   further, for the gradient normals of every vertex with NM_GRADIENT
+	//   (two voxels past the edit at lod 0) and of transition vertices
+	// The chunk may be remeshed at another level or with the other normal
+	// mode (see set_normal_mode) without being refilled, so the margin
+	// covers the widest reads rather than the ones of its current mesh.
+	if (c->voxels.length() == 0) {
+		c->voxels.resize(N*N*N);
+		fill(c->voxels.sub(), c->bounds.min);
+		c->pyramid.build(c->voxels, Vec3i(N));
+		c->generated_blocks = 0;
+	}
+	if (c->generated_blocks != ~uint64_t(0)) {
+		const Vec3i origin = c->origin();
+		const int corner_reach = 1 << MAX_LOD;
+		const int gradient_reach = 1;
+		const int margin = corner_reach + gradient_reach;
+		const Vec3i lmin = ::max(min - Vec3i(margin) - origin, Vec3i(0));
+		const Vec3i lmax = ::min(max + Vec3i(margin) - origin, Vec3i(CHUNK_SIZE));
+		generate_blocks(this, c, lmin, lmax);
+	}
+	return c;
+}
+
+void ChunkManager::edit_sphere(const Vec3f &center, float radius, bool fill)
+{
+	const Vec3i min = floor(center - Vec3f(radius));
+	const Vec3i max = floor(center + Vec3f(radius)) + Vec3i(1);
+
+	// roughly the scale of the terrain field, which changes by
+	// 1/height_scale per voxel vertically
+	const float scale = 1.0f / terrain.height_scale;
+	edit(min, max, [&](const Vec3i &p, float v) {
+		const float d = (length(ToVec3f(p) - center) - radius) * scale;
+		return fill ? std::min(v, d) : std::max(v, -d);
+	});
+}
+
+void ChunkManager::mark_dirty(const Vec3i &min, const Vec3i &max)
+{
+	dirty_regions.append({min, max});
+}
+
+void ChunkManager::remesh_dirty()
+{
+	if (dirty_regions.length() == 0)
+		return;
+
+	// a chunk is remeshed once, no matter how many regions touch it
+	Vector<Chunk*> dirty;
+	for (const DirtyRegion &r : dirty_regions) {
+		Vec3i cmin, cmax;
+		chunks_of(&cmin, &cmax, r.min, r.max);
+		for (int cz = cmin.z; cz <= cmax.z; cz++) {
+		for (int cy = cmin.y; cy <= cmax.y; cy++) {
+		for (int cx = cmin.x; cx <= cmax.x; cx++) {
+			Chunk *c = find(Vec3i(cx, cy, cz));
+			if (!c || c->dirty || !c->meshed)
+				continue;
+			c->dirty = true;
+			dirty.append(c);
+		}}}
+	}
+	dirty_regions.clear();
+
+	for (Chunk *c : dirty) {
+		c->dirty = false;
+		// keeps the capacity, so the cache accounting stays right and
+		// the new mesh usually fits without reallocating
+		c->mesh.clear();
+		if (!c->active) {
+			c->meshed = false;
+			continue;
+		}
+		// simplifying takes longer than meshing, a far chunk is remeshed in
+		// full now and simplified when update() gets to it, after the
+		// chunks which aren't there at all
+		ChunkDetail detail = wanted_detail(*this, c->coords);
+		const bool simplify = detail.simplified;
+		detail.simplified = false;
+		mesh_chunk(this, c, detail);
+		if (simplify)
+			pending.insert(0, c->coords);
+	}
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <unordered_map>
+#include "Core/Vector.h"
+#include "Math/Vec.h"
+#include "Mesh/Mesher.h"
+#include "Mesh/MeshContext.h"
+#include "Mesh/BrickPyramid.h"
+#include "Mesh/Terrain.h"
+
+// How a chunk is meshed, depends on its distance from the camera.
+struct ChunkDetail {
+	// smooth marching cubes: the voxel stride is 1 << lod, the faces (GridFace
+	// flags) bordering a chunk with half the stride get transition cells
+	int lod = 0;
+	int transition_faces = 0;
+
+	// the other mesh types: simplified, with fewer triangles
+	bool simplified = false;
+
+	bool operator==(const ChunkDetail &r) const
+	{
+		return lod == r.lod && transition_faces == r.transition_faces &&
+			simplified == r.simplified;
+	}
+	bool operator!=(const ChunkDetail &r) const { return !(*this == r); }
+};
+
+struct Chunk {
+	Vec3i coords;
+
+	// (CHUNK_SIZE+1)^3 voxels, the last layer in each direction is shared
+	// with the neighbour, empty if the chunk has no surface crossing
+	Vector<float> voxels;
+	MinMax bounds;
+
+	// of the voxels, kept up to date by edits, empty without voxels
+	BrickPyramid pyramid;
+
+	// chunk-local positions, the chunk starts at origin()
+	Mesh mesh;
+
+	bool active = false;
+	bool meshed = false;
+
+	// what the mesh was made with
+	ChunkDetail detail;
+
+	// different for every mesh made by the manager, copies of the mesh (the
+	// buffers it's drawn from) are stale when it changes
+	uint64_t mesh_revision = 0;
+
+	// edited chunks can't be regenerated from the terrain, they are never
+	// evicted and keep their voxels even if there is no crossing
+	bool edited = false;
+	bool dirty = false;
+
+	// One bit per 8^3 block of voxels (the last block in each direction is
+	// 9 voxels wide), set if the block holds the terrain. The voxels of a
+	// chunk without a crossing are brought back a block at a time when it
+	// gets edited, the rest of them only have the right sign.
+	uint64_t generated_blocks = ~uint64_t(0);
+
+	// LRU list of inactive chunks, most recently used first
+	Chunk *lru_prev = nullptr;
+	Chunk *lru_next = nullptr;
+
+	Vec3i origin() const;
+	int64_t memory_usage() const;
+};
+
+// Box of voxels in world voxel coordinates, both ends inclusive.
+struct DirtyRegion {
+	Vec3i min;
+	Vec3i max;
+};
+
+// Keeps the chunks around the camera generated and meshed. Chunks which go out
+// of the view radius are kept in an LRU cache until it exceeds its memory
+// limit, coming back to a cached chunk costs nothing.
+struct ChunkManager {
+	static constexpr int CHUNK_SIZE = 32;
+
+	// the coarsest level smooth marching cubes chunks are meshed at
+	static constexpr int MAX_LOD = 2;
+
+	TerrainGenerator terrain;
+	MeshType mesh_type = MT_MARCHING_CUBES_SMOOTH;
+
+	// in chunks, around the chunk the camera is in
+	int view_radius = 4;
+	int vertical_radius = 2;
+
+	// Chunks further than this (horizontally, in chunks) get less detail.
+	// Smooth marching cubes meshes them at twice the voxel stride, and at
+	// four times beyond detail_radius + lod_ring (at least 1, so that chunks
+	// next to each other are one level apart at most). The other mesh types
+	// get simplified meshes with 1/far_reduction of the triangles. A chunk
+	// is remeshed when its detail changes.
+	int detail_radius = 2;
+	int lod_ring = 1;
+	int far_reduction = 6;
+
+	int64_t cache_memory_limit = 256 * 1024 * 1024;
+
+	// time update() may spend on producing new chunks, at least one chunk
+	// is produced per update regardless
+	double time_budget_ms = 4.0;
+
+	std::unordered_map<Vec3i, Chunk*, Vec3iHash> chunks;
+
+	// chunks within the view radius which are ready to be drawn
+	Vector<Chunk*> active;
+
+	// chunks within the view radius which aren't generated yet, nearest last
+	Vector<Vec3i> pending;
+
+	// regions changed since the last remesh_dirty()
+	Vector<DirtyRegion> dirty_regions;
+
+	Chunk *lru_head = nullptr;
+	Chunk *lru_tail = nullptr;
+	int64_t cache_memory = 0;
+
+	Vec3i center = Vec3i(0);
+	bool center_valid = false;
+
+	// last Chunk::mesh_revision handed out
+	uint64_t mesh_revisions = 0;
+
+	// shared by all the chunk meshing, chunks are meshed one at a time
+	MeshContext context;
+
+	NG_DELETE_COPY_AND_MOVE(ChunkManager);
+
+	explicit ChunkManager(int seed);
+	~ChunkManager();
+
+	static Vec3i chunk_of(const Vec3f &position);
+
+	void update(const Vec3f &camera_position);
+
+	// drop all the meshes and regenerate them with the new settings
+	void set_mesh_type(MeshType type);
+	void set_normal_mode(NormalMode mode);
+
+	Chunk *find(const Vec3i &coords) const;
+
+	// Range of chunks which store the voxels of the given region. A voxel on
+	// a chunk boundary is stored by every chunk sharing it.
+	static void chunks_of(Vec3i *cmin, Vec3i *cmax, const Vec3i &min, const Vec3i &max);
+
+	// Returns the chunk with the voxels of the [min, max] region (world
+	// coordinates) and the ones the meshers read around it generated, marks
+	// it as edited.
+	Chunk *editable_chunk(const Vec3i &coords, const Vec3i &min, const Vec3i &max);
+
+	// Replaces every voxel 'v' at 'p' within the [min, max] region with
+	// 'f(p, v)' and marks the region dirty.
+	template <typename F>
+	void edit(const Vec3i &min, const Vec3i &max, F &&f);
+
+	// Digs a sphere out of the terrain or fills it, depending on 'fill'.
+	void edit_sphere(const Vec3f &center, float radius, bool fill);
+
+	void mark_dirty(const Vec3i &min, const Vec3i &max);
+
+	// Remeshes the active chunks touched by the dirty regions, the rest are
+	// remeshed when they come into view. Called by update().
+	void remesh_dirty();
+};
+
+template <typename F>
+void ChunkManager::edit(const Vec3i &min, const Vec3i &max, F &&f)
+{
+	constexpr int N = CHUNK_SIZE + 1;
+	Vec3i cmin, cmax;
+	chunks_of(&cmin, &cmax, min, max);
+	for (int cz = cmin.z; cz <= cmax.z; cz++) {
+	for (int cy = cmin.y; cy <= cmax.y; cy++) {
+	for (int cx = cmin.x; cx <= cmax.x; cx++) {
+		Chunk *c = editable_chunk(Vec3i(cx, cy, cz), min, max);
+		const Vec3i origin = c->origin();
+		const Vec3i lmin = ::max(min - origin, Vec3i(0));
+		const Vec3i lmax = ::min(max - origin, Vec3i(CHUNK_SIZE));
+		for (int z = lmin.z; z <= lmax.z; z++) {
+		for (int y = lmin.y; y <= lmax.y; y++) {
+			float *row = &c->voxels[offset_3d(Vec3i(0, y, z), Vec3i(N))];
+			for (int x = lmin.x; x <= lmax.x; x++) {
+				const float v = f(origin + Vec3i(x, y, z), row[x]);
+				row[x] = v;
+				// conservative, the bounds only have to contain the values
+				c->bounds.min = std::min(c->bounds.min, v);
+				c->bounds.max = std::max(c->bounds.max, v);
+			}
+		}}
+		c->pyramid.update(c->voxels, lmin, lmax);
+		NG_ASSERT(c->pyramid.matches(c->voxels));
+	}}}
+	mark_dirty(min, max);
+}
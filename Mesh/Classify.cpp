@@ -0,0 +1,338 @@
+#include "Mesh/Classify.h"
+#include "Core/Utils.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+	#include <immintrin.h>
+	#define NG_CLASSIFY_X86
+#endif
+
+//----------------------------------------------------------------------------
+// Scalar
+//----------------------------------------------------------------------------
+
+static inline int cell_config(const float *r00, const float *r10,
+	const float *r01, const float *r11, int x)
+{
+	return
+		((r00[x]   < 0.0f) << 0) |
+		((r00[x+1] < 0.0f) << 1) |
+		((r10[x]   < 0.0f) << 2) |
+		((r10[x+1] < 0.0f) << 3) |
+		((r01[x]   < 0.0f) << 4) |
+		((r01[x+1] < 0.0f) << 5) |
+		((r11[x]   < 0.0f) << 6) |
+		((r11[x+1] < 0.0f) << 7);
+}
+
+static inline int classify_cells_tail(ActiveCell *out, const float *r00,
+	const float *r10, const float *r01, const float *r11, int x0, int x1)
+{
+	int n = 0;
+	for (int x = x0; x < x1; x++) {
+		const int config = cell_config(r00, r10, r01, r11, x);
+		if (config != 0 && config != 255)
+			out[n++] = {x, config};
+	}
+	return n;
+}
+
+static int classify_cells_scalar(ActiveCell *out, const float *r00,
+	const float *r10, const float *r01, const float *r11, int x0, int x1)
+{
+	return classify_cells_tail(out, r00, r10, r01, r11, x0, x1);
+}
+
+template <typename T>
+static inline void pack_signs_tail(uint64_t *dst, const T *src, int i, int n)
+{
+	for (; i < n; i++) {
+		if (i % 64 == 0)
+			dst[i / 64] = 0;
+		dst[i / 64] |= uint64_t(sample_inside(src[i])) << (i % 64);
+	}
+}
+
+static void pack_signs_scalar(uint64_t *dst, const float *src, int n)
+{
+	pack_signs_tail(dst, src, 0, n);
+}
+
+//----------------------------------------------------------------------------
+// SSE2/AVX2
+//----------------------------------------------------------------------------
+
+#ifdef NG_CLASSIFY_X86
+
+// The eight corner compares of 4 (or 8) neighbouring cells are done as vector
+// compares, each compare result is masked with its corner bit and OR-ed into
+// a per-lane config. Lanes with config 0 or 255 are dropped using movemask.
+
+__attribute__((target("sse2")))
+static int classify_cells_sse2(ActiveCell *out, const float *r00,
+	const float *r10, const float *r01, const float *r11, int x0, int x1)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128i all = _mm_set1_epi32(255);
+	const float *rows[4] = {r00, r10, r01, r11};
+	alignas(16) int configs[4];
+	int n = 0;
+	int x = x0;
+	for (; x + 4 <= x1; x += 4) {
+		__m128i config = _mm_setzero_si128();
+		for (int r = 0; r < 4; r++) {
+			const __m128 a = _mm_cmplt_ps(_mm_loadu_ps(rows[r] + x), zero);
+			const __m128 b = _mm_cmplt_ps(_mm_loadu_ps(rows[r] + x + 1), zero);
+			config = _mm_or_si128(config, _mm_and_si128(_mm_castps_si128(a), _mm_set1_epi32(1 << (r*2))));
+			config = _mm_or_si128(config, _mm_and_si128(_mm_castps_si128(b), _mm_set1_epi32(2 << (r*2))));
+		}
+		const __m128i empty = _mm_or_si128(
+			_mm_cmpeq_epi32(config, _mm_setzero_si128()),
+			_mm_cmpeq_epi32(config, all));
+		int active = ~_mm_movemask_ps(_mm_castsi128_ps(empty)) & 0xF;
+		if (!active)
+			continue;
+
+		_mm_store_si128((__m128i*)configs, config);
+		while (active) {
+			const int i = __builtin_ctz(active);
+			out[n++] = {x + i, configs[i]};
+			active &= active - 1;
+		}
+	}
+	return n + classify_cells_tail(out + n, r00, r10, r01, r11, x, x1);
+}
+
+__attribute__((target("avx2")))
+static int classify_cells_avx2(ActiveCell *out, const float *r00,
+	const float *r10, const float *r01, const float *r11, int x0, int x1)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256i all = _mm256_set1_epi32(255);
+	const float *rows[4] = {r00, r10, r01, r11};
+	alignas(32) int configs[8];
+	int n = 0;
+	int x = x0;
+	for (; x + 8 <= x1; x += 8) {
+		__m256i config = _mm256_setzero_si256();
+		for (int r = 0; r < 4; r++) {
+			const __m256 a = _mm256_cmp_ps(_mm256_loadu_ps(rows[r] + x), zero, _CMP_LT_OQ);
+			const __m256 b = _mm256_cmp_ps(_mm256_loadu_ps(rows[r] + x + 1), zero, _CMP_LT_OQ);
+			config = _mm256_or_si256(config, _mm256_and_si256(_mm256_castps_si256(a), _mm256_set1_epi32(1 << (r*2))));
+			config = _mm256_or_si256(config, _mm256_and_si256(_mm256_castps_si256(b), _mm256_set1_epi32(2 << (r*2))));
+		}
+		const __m256i empty = _mm256_or_si256(
+			_mm256_cmpeq_epi32(config, _mm256_setzero_si256()),
+			_mm256_cmpeq_epi32(config, all));
+		int active = ~_mm256_movemask_ps(_mm256_castsi256_ps(empty)) & 0xFF;
+		if (!active)
+			continue;
+
+		_mm256_store_si256((__m256i*)configs, config);
+		while (active) {
+			const int i = __builtin_ctz(active);
+			out[n++] = {x + i, configs[i]};
+			active &= active - 1;
+		}
+	}
+	return n + classify_cells_tail(out + n, r00, r10, r01, r11, x, x1);
+}
+
+__attribute__((target("sse2")))
+static void pack_signs_sse2(uint64_t *dst, const float *src, int n)
+{
+	const __m128 zero = _mm_setzero_ps();
+	int i = 0;
+	for (; i + 64 <= n; i += 64) {
+		uint64_t word = 0;
+		for (int j = 0; j < 64; j += 4) {
+			const __m128 lt = _mm_cmplt_ps(_mm_loadu_ps(src + i + j), zero);
+			word |= uint64_t(_mm_movemask_ps(lt)) << j;
+		}
+		dst[i / 64] = word;
+	}
+	pack_signs_tail(dst, src, i, n);
+}
+
+__attribute__((target("avx2")))
+static void pack_signs_avx2(uint64_t *dst, const float *src, int n)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	int i = 0;
+	for (; i + 64 <= n; i += 64) {
+		uint64_t word = 0;
+		for (int j = 0; j < 64; j += 8) {
+			const __m256 lt = _mm256_cmp_ps(_mm256_loadu_ps(src + i + j), zero, _CMP_LT_OQ);
+			word |= uint64_t(_mm256_movemask_ps(lt)) << j;
+		}
+		dst[i / 64] = word;
+	}
+	pack_signs_tail(dst, src, i, n);
+}
+
+// The quantized formats get SSE2 only, the signs of 16 samples fit a single
+// movemask either way.
+
+__attribute__((target("sse2")))
+static void pack_signs_sse2(uint64_t *dst, const int8_t *src, int n)
+{
+	int i = 0;
+	for (; i + 64 <= n; i += 64) {
+		uint64_t word = 0;
+		for (int j = 0; j < 64; j += 16) {
+			const __m128i v = _mm_loadu_si128((const __m128i*)(src + i + j));
+			word |= uint64_t(_mm_movemask_epi8(v)) << j;
+		}
+		dst[i / 64] = word;
+	}
+	pack_signs_tail(dst, src, i, n);
+}
+
+__attribute__((target("sse2")))
+static void pack_signs_sse2(uint64_t *dst, const uint16_t *src, int n)
+{
+	// inside is below 32768, i.e. the top bit is clear
+	int i = 0;
+	for (; i + 64 <= n; i += 64) {
+		uint64_t word = 0;
+		for (int j = 0; j < 64; j += 16) {
+			const __m128i a = _mm_loadu_si128((const __m128i*)(src + i + j));
+			const __m128i b = _mm_loadu_si128((const __m128i*)(src + i + j + 8));
+			const int outside = _mm_movemask_epi8(_mm_packs_epi16(a, b));
+			word |= uint64_t(~outside & 0xFFFF) << j;
+		}
+		dst[i / 64] = word;
+	}
+	pack_signs_tail(dst, src, i, n);
+}
+
+__attribute__((target("sse2")))
+static void pack_signs_sse2(uint64_t *dst, const Half *src, int n)
+{
+	// as int16, inside is [-32767, -1], -32768 being -0
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i negative_zero = _mm_set1_epi16(-32768);
+	int i = 0;
+	for (; i + 64 <= n; i += 64) {
+		uint64_t word = 0;
+		for (int j = 0; j < 64; j += 16) {
+			__m128i a = _mm_loadu_si128((const __m128i*)(src + i + j));
+			__m128i b = _mm_loadu_si128((const __m128i*)(src + i + j + 8));
+			a = _mm_and_si128(_mm_cmplt_epi16(a, zero), _mm_cmpgt_epi16(a, negative_zero));
+			b = _mm_and_si128(_mm_cmplt_epi16(b, zero), _mm_cmpgt_epi16(b, negative_zero));
+			word |= uint64_t(_mm_movemask_epi8(_mm_packs_epi16(a, b))) << j;
+		}
+		dst[i / 64] = word;
+	}
+	pack_signs_tail(dst, src, i, n);
+}
+
+#endif // NG_CLASSIFY_X86
+
+//----------------------------------------------------------------------------
+// Dispatch
+//----------------------------------------------------------------------------
+
+typedef int (*ClassifyCellsFunc)(ActiveCell*, const float*, const float*,
+	const float*, const float*, int, int);
+typedef void (*PackSignsFunc)(uint64_t*, const float*, int);
+
+static ClassifyKernel kernel = CK_SCALAR;
+static ClassifyCellsFunc classify_cells_impl = classify_cells_scalar;
+static PackSignsFunc pack_signs_impl = pack_signs_scalar;
+
+static bool cpu_supports(ClassifyKernel k)
+{
+#ifdef NG_CLASSIFY_X86
+	// we might run before the constructors of libgcc
+	__builtin_cpu_init();
+#endif
+	switch (k) {
+	case CK_SCALAR:
+		return true;
+#ifdef NG_CLASSIFY_X86
+	case CK_SSE2:
+		return __builtin_cpu_supports("sse2");
+	case CK_AVX2:
+		return __builtin_cpu_supports("avx2");
+#endif
+	default:
+		return false;
+	}
+}
+
+bool use_classify_kernel(ClassifyKernel k)
+{
+	if (!cpu_supports(k))
+		return false;
+
+	kernel = k;
+	switch (k) {
+	case CK_SCALAR:
+		classify_cells_impl = classify_cells_scalar;
+		pack_signs_impl = pack_signs_scalar;
+		break;
+#ifdef NG_CLASSIFY_X86
+	case CK_SSE2:
+		classify_cells_impl = classify_cells_sse2;
+		pack_signs_impl = pack_signs_sse2;
+		break;
+	case CK_AVX2:
+		classify_cells_impl = classify_cells_avx2;
+		pack_signs_impl = pack_signs_avx2;
+		break;
+#endif
+	}
+	return true;
+}
+
+ClassifyKernel current_classify_kernel()
+{
+	return kernel;
+}
+
+static bool select_best_kernel()
+{
+	return use_classify_kernel(CK_AVX2) || use_classify_kernel(CK_SSE2) ||
+		use_classify_kernel(CK_SCALAR);
+}
+
+static const bool best_kernel_selected = select_best_kernel();
+
+int classify_cells(ActiveCell *out, const float *r00, const float *r10,
+	const float *r01, const float *r11, int x0, int x1)
+{
+	NG_ASSERT(x0 <= x1);
+	return classify_cells_impl(out, r00, r10, r01, r11, x0, x1);
+}
+
+void pack_signs(uint64_t *dst, const float *src, int n)
+{
+	pack_signs_impl(dst, src, n);
+}
+
+template <typename T>
+static void pack_signs_quantized(uint64_t *dst, const T *src, int n)
+{
+#ifdef NG_CLASSIFY_X86
+	if (kernel != CK_SCALAR) {
+		pack_signs_sse2(dst, src, n);
+		return;
+	}
+#endif
+	pack_signs_tail(dst, src, 0, n);
+}
+
+void pack_signs(uint64_t *dst, const int8_t *src, int n)
+{
+	pack_signs_quantized(dst, src, n);
+}
+
+void pack_signs(uint64_t *dst, const uint16_t *src, int n)
+{
+	pack_signs_quantized(dst, src, n);
+}
+
+void pack_signs(uint64_t *dst, const Half *src, int n)
+{
+	pack_signs_quantized(dst, src, n);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include "Mesh/Sample.h"
+
+struct ActiveCell {
+	int x;
+	int config;
+};
+
+enum ClassifyKernel {
+	CK_SCALAR,
+	CK_SSE2,
+	CK_AVX2,
+};
+
+// Computes the marching cubes configuration of cells [x0, x1) in a row of
+// cells. The row is given by the four voxel rows around it: r00 at (y, z),
+// r10 at (y+1, z), r01 at (y, z+1) and r11 at (y+1, z+1). Cells with a
+// surface crossing are written to 'out' (which needs room for x1 - x0
+// entries) in increasing x order, returns the number of them.
+int classify_cells(ActiveCell *out, const float *r00, const float *r10,
+	const float *r01, const float *r11, int x0, int x1);
+
+// Sets bit i of dst[i / 64] if src[i] is inside, for i in [0, n).
+void pack_signs(uint64_t *dst, const float *src, int n);
+void pack_signs(uint64_t *dst, const int8_t *src, int n);
+void pack_signs(uint64_t *dst, const uint16_t *src, int n);
+void pack_signs(uint64_t *dst, const Half *src, int n);
+
+// The best kernel supported by the CPU is picked at startup, this one lets you
+// force a different one. Returns false if the CPU doesn't support it.
+bool use_classify_kernel(ClassifyKernel kernel);
+ClassifyKernel current_classify_kernel();
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Core/Vector.h"
+#include "Math/Vec.h"
+#include "Mesh/Mesher.h"
+#include "Mesh/SignVolume.h"
+
+// Per-voxel values of two consecutive z layers, layer z lives in slot z % 2.
+// A mesher sweeping the grid along z only ever needs the layer it's on and
+// the one before, whatever the grid size is.
+template <typename T>
+struct SlabRing {
+	Vector<T> slots;
+	Vec3i size = Vec3i(0);
+
+	// keeps the memory if the new size fits
+	void resize(const Vec3i &size)
+	{
+		this->size = size;
+		slots.resize(size.x * size.y * 2);
+	}
+
+	T &operator[](const Vec3i &p) { return slots[offset_3d_slab(p, size)]; }
+	const T &operator[](const Vec3i &p) const { return slots[offset_3d_slab(p, size)]; }
+};
+
+// Scratch memory of the meshers, resized to the grid by every call. Passing
+// the same context to consecutive calls saves allocating it over and over. A
+// context can only be used by one call at a time, meshing on several threads
+// at once takes a context per thread.
+struct MeshContext {
+	// how vertex normals are computed, the only setting a context has
+	NormalMode normals = NM_FACES;
+
+	SignVolume signs;
+
+	// smooth marching cubes: indices of the vertices on the x, y and z edges
+	// going out of every voxel
+	SlabRing<Vec3i> edges;
+
+	// surface nets: index of the vertex of every cell
+	SlabRing<int> cells;
+
+	// LOD meshing: the samples of the coarse grid, indices of the vertices
+	// on the x, y and z edges going out of every coarse sample, of the ones
+	// on the u and v edges of the fine grid of a transition face, and of the
+	// ones on the fine edges two transition faces share
+	Vector<float> lod_samples;
+	Vector<Vec3i> lod_edges;
+	Vector<Vec2i> transition_edges;
+	Vector<int> transition_line_edges;
+
+	// packed output with face normals: the mesh before packing
+	Mesh unpacked;
+};
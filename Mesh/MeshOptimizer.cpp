@@ -0,0 +1,219 @@
+#include "Mesh/MeshOptimizer.h"
+#include "Core/Parallel.h"
+#include <cmath>
+
+float acmr(Slice<const int> indices, int num_vertices, int cache_size)
+{
+	NG_ASSERT(indices.length % 3 == 0);
+	if (indices.length == 0)
+		return 0.0f;
+
+	// the cache holds the last 'cache_size' vertices loaded, a vertex is a
+	// miss if more loads than that happened since its own
+	ArenaScope scope(scratch_arena());
+	int *loaded = allocate_memory<int>(scope.arena, num_vertices);
+	fill(Slice<int>(loaded, num_vertices), -cache_size-1);
+	int misses = 0;
+	for (int idx : indices) {
+		if (misses - loaded[idx] > cache_size)
+			loaded[idx] = misses++;
+	}
+	return (float)misses / (indices.length / 3);
+}
+
+//----------------------------------------------------------------------------
+// Forsyth's vertex cache optimisation
+//----------------------------------------------------------------------------
+
+// Size of the modelled LRU cache, the result doesn't depend much on it
+// matching the hardware.
+static constexpr int CACHE_SIZE = 16;
+
+// cache_pos of the vertices of the triangle being emitted
+static constexpr int IN_TRIANGLE = -2;
+
+// valence boost is only tabulated for vertices with few triangles left
+static constexpr int MAX_VALENCE = 32;
+
+struct VertexScores {
+	float cache[CACHE_SIZE];
+	float valence[MAX_VALENCE];
+
+	VertexScores()
+	{
+		for (int i = 0; i < CACHE_SIZE; i++) {
+			// vertices of the last triangle get a fixed score, favouring
+			// them more would make long thin strips
+			if (i < 3)
+				cache[i] = 0.75f;
+			else
+				cache[i] = std::pow(1.0f - (i - 3) * (1.0f / (CACHE_SIZE - 3)), 1.5f);
+		}
+		valence[0] = 0.0f;
+		for (int i = 1; i < MAX_VALENCE; i++)
+			valence[i] = 2.0f / std::sqrt((float)i);
+	}
+
+	// a vertex with no triangles left has no say in picking the next one
+	float get(int cache_pos, int remaining) const
+	{
+		if (remaining == 0)
+			return -1.0f;
+		const float c = cache_pos >= 0 ? cache[cache_pos] : 0.0f;
+		if (remaining < MAX_VALENCE)
+			return c + valence[remaining];
+		return c + 2.0f / std::sqrt((float)remaining);
+	}
+};
+
+static const VertexScores vertex_scores;
+
+void optimize_vertex_cache(Slice<int> indices, int num_vertices)
+{
+	NG_ASSERT(indices.length % 3 == 0);
+	const int n_tris = indices.length / 3;
+	if (n_tris == 0)
+		return;
+
+	// all the scratch memory comes from the thread's arena, optimizing one
+	// mesh after another doesn't allocate
+	ArenaScope scope(scratch_arena());
+	Arena *arena = scope.arena;
+
+	// triangles using every vertex, the first 'remaining[v]' entries of a
+	// vertex's list are the ones not emitted yet
+	int *remaining = allocate_memory<int>(arena, num_vertices);
+	int *offsets = allocate_memory<int>(arena, num_vertices);
+	int *adjacency = allocate_memory<int>(arena, indices.length);
+	const int *in = indices.data;
+	clear_memory(remaining, num_vertices);
+	for (int i = 0; i < indices.length; i++)
+		remaining[in[i]]++;
+	parallel_scan(Slice<int>(remaining, num_vertices), Slice<int>(offsets, num_vertices),
+		0, [](int a, int b) { return a + b; }, 65536);
+	clear_memory(remaining, num_vertices);
+	for (int i = 0; i < indices.length; i++) {
+		const int v = in[i];
+		adjacency[offsets[v] + remaining[v]++] = i / 3;
+	}
+
+	int *cache_pos = allocate_memory<int>(arena, num_vertices);
+	float *scores = allocate_memory<float>(arena, num_vertices);
+	fill(Slice<int>(cache_pos, num_vertices), -1);
+	for (int v = 0; v < num_vertices; v++)
+		scores[v] = vertex_scores.get(-1, remaining[v]);
+
+	float *tri_scores = allocate_memory<float>(arena, n_tris);
+	uint8_t *emitted = allocate_memory<uint8_t>(arena, n_tris);
+	clear_memory(emitted, n_tris);
+	int best = 0;
+	for (int t = 0; t < n_tris; t++) {
+		const int *tri = in + t*3;
+		tri_scores[t] = scores[tri[0]] + scores[tri[1]] + scores[tri[2]];
+		if (tri_scores[t] > tri_scores[best])
+			best = t;
+	}
+
+	int *out = allocate_memory<int>(arena, indices.length);
+	int cache[CACHE_SIZE + 3];
+	int cache_len = 0;
+	int next_unemitted = 0;
+	for (int i = 0; i < n_tris; i++) {
+		// dead end, nothing in the cache has triangles left, continue
+		// with the first triangle in input order
+		if (best < 0) {
+			while (emitted[next_unemitted])
+				next_unemitted++;
+			best = next_unemitted;
+		}
+
+		const int t = best;
+		emitted[t] = 1;
+		int new_cache[CACHE_SIZE + 3];
+		int n = 0;
+		for (int k = 0; k < 3; k++) {
+			const int v = in[t*3+k];
+			out[i*3+k] = v;
+
+			int *tris = adjacency + offsets[v];
+			for (int j = 0; j < remaining[v]; j++) {
+				if (tris[j] == t) {
+					tris[j] = tris[--remaining[v]];
+					break;
+				}
+			}
+			// the triangle's vertices go to the front, marked so that
+			// they're skipped when shifting the rest of the cache
+			if (cache_pos[v] != IN_TRIANGLE) {
+				cache_pos[v] = IN_TRIANGLE;
+				new_cache[n++] = v;
+			}
+		}
+		for (int j = 0; j < cache_len; j++) {
+			const int v = cache[j];
+			if (cache_pos[v] != IN_TRIANGLE)
+				new_cache[n++] = v;
+		}
+
+		// rescore everything which moved in or out of the cache and pick
+		// the best triangle touching it. Like in the original, a triangle
+		// is judged by the score it has when one of its vertices is
+		// updated, which saves a second pass and hardly changes the
+		// result.
+		best = -1;
+		float best_score = -1.0f;
+		for (int j = 0; j < n; j++) {
+			const int v = new_cache[j];
+			cache_pos[v] = j < CACHE_SIZE ? j : -1;
+			const float score = vertex_scores.get(cache_pos[v], remaining[v]);
+			const float delta = score - scores[v];
+			scores[v] = score;
+			const int *tris = adjacency + offsets[v];
+			for (int k = 0; k < remaining[v]; k++) {
+				const float ts = tri_scores[tris[k]] += delta;
+				if (ts > best_score) {
+					best_score = ts;
+					best = tris[k];
+				}
+			}
+		}
+		cache_len = std::min(n, CACHE_SIZE);
+		copy_memory(cache, new_cache, cache_len);
+	}
+	copy(indices, Slice<const int>(out, indices.length));
+}
+
+void optimize_vertex_fetch(Mesh *mesh)
+{
+	const int n_vertices = mesh->vertices.length();
+	ArenaScope scope(scratch_arena());
+	int *remap = allocate_memory<int>(scope.arena, n_vertices);
+	fill(Slice<int>(remap, n_vertices), -1);
+	int next = 0;
+	for (int &idx : mesh->indices) {
+		if (remap[idx] < 0)
+			remap[idx] = next++;
+		idx = remap[idx];
+	}
+	for (int v = 0; v < n_vertices; v++) {
+		if (remap[v] < 0)
+			remap[v] = next++;
+	}
+
+	Vertex *vertices = allocate_memory<Vertex>(scope.arena, n_vertices);
+	for (int v = 0; v < n_vertices; v++)
+		vertices[remap[v]] = mesh->vertices[v];
+	// copied back rather than moved in, the mesh keeps its capacity
+	copy(mesh->vertices.sub(), Slice<const Vertex>(vertices, n_vertices));
+}
+
+void optimize_mesh(Mesh *mesh, MeshOptimizeStats *stats)
+{
+	const int n_vertices = mesh->vertices.length();
+	if (stats)
+		stats->acmr_before = acmr(mesh->indices, n_vertices);
+	optimize_vertex_cache(mesh->indices, n_vertices);
+	optimize_vertex_fetch(mesh);
+	if (stats)
+		stats->acmr_after = acmr(mesh->indices, n_vertices);
+}
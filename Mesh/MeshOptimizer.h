@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Core/Slice.h"
+#include "Mesh/Mesher.h"
+
+// Average cache miss ratio: vertices transformed per triangle by a GPU with a
+// FIFO post-transform cache of 'cache_size' entries. 3 means no reuse at all,
+// about 0.6 is the best a large regular grid can do.
+float acmr(Slice<const int> indices, int num_vertices, int cache_size = 16);
+
+struct MeshOptimizeStats {
+	float acmr_before = 0.0f;
+	float acmr_after = 0.0f;
+};
+
+// Reorders the triangles of a triangle list for the post-transform vertex
+// cache, using Tom Forsyth's linear-speed vertex cache optimisation. Runs in
+// time linear in the number of triangles.
+void optimize_vertex_cache(Slice<int> indices, int num_vertices);
+
+// Renumbers the vertices in the order the indices first use them, so that
+// vertex fetches go through memory roughly linearly. Vertices which aren't
+// used at all keep their relative order at the end.
+void optimize_vertex_fetch(Mesh *mesh);
+
+// Both of the above, optionally measuring the ACMR before and after.
+void optimize_mesh(Mesh *mesh, MeshOptimizeStats *stats = nullptr);
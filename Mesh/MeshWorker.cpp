@@ -0,0 +1,88 @@
+#include "Mesh/MeshWorker.h"
+
+static void run(MeshWorker *w)
+{
+	for (;;) {
+		MeshType type;
+		NormalMode normals;
+		{
+			std::unique_lock<std::mutex> lock(w->mutex);
+			w->wake.wait(lock, [w] { return w->has_request || w->quit; });
+			if (w->quit)
+				return;
+			type = w->requested_type;
+			normals = w->requested_normals;
+			w->has_request = false;
+		}
+
+		MeshSnapshot *s = w->recycled.exchange(nullptr);
+		if (!s)
+			s = new MeshSnapshot;
+		s->mesh.clear();
+		s->type = type;
+		s->normals = normals;
+		s->revision = ++w->revisions;
+
+		w->context.normals = normals;
+		if (type == MT_MARCHING_CUBES_SMOOTH) {
+			generate_geometry_smooth_parallel(&s->mesh, w->voxels, w->size, 0,
+				w->pyramid, &w->context);
+		} else {
+			generate_mesh(&s->mesh, type, w->voxels, w->size, w->pyramid,
+				&w->context);
+		}
+
+		// the owner never saw the one this replaces, it can be reused
+		MeshSnapshot *old = w->published.exchange(s);
+		if (old)
+			delete w->recycled.exchange(old);
+	}
+}
+
+MeshWorker::MeshWorker(Slice<const float> voxels, const Vec3i &size,
+	const BrickPyramid *pyramid):
+	voxels(voxels), size(size), pyramid(pyramid), published(nullptr),
+	recycled(nullptr)
+{
+}
+
+MeshWorker::~MeshWorker()
+{
+	if (thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_one();
+		thread.join();
+	}
+	delete published.load();
+	delete recycled.load();
+	delete current;
+}
+
+void MeshWorker::request(MeshType type, NormalMode normals)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		requested_type = type;
+		requested_normals = normals;
+		has_request = true;
+	}
+	wake.notify_one();
+	if (!thread.joinable())
+		thread = std::thread(run, this);
+}
+
+const MeshSnapshot *MeshWorker::latest()
+{
+	MeshSnapshot *s = published.exchange(nullptr);
+	if (s) {
+		// the worker hasn't picked up the one given back before, keep
+		// the newer one
+		if (current)
+			delete recycled.exchange(current);
+		current = s;
+	}
+	return current;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "Core/Utils.h"
+#include "Core/Vector.h"
+#include "Math/Vec.h"
+#include "Mesh/Mesher.h"
+#include "Mesh/MeshContext.h"
+
+struct BrickPyramid;
+
+// A finished mesh, never modified after it's published.
+struct MeshSnapshot {
+	Mesh mesh;
+	MeshType type = MT_MARCHING_CUBES;
+	NormalMode normals = NM_FACES;
+
+	// different for every snapshot of a worker, starting at 1
+	uint64_t revision = 0;
+};
+
+// Meshes a grid on a thread of its own. The owner asks for meshes with
+// request() and picks the latest finished one with latest(), neither of
+// which waits for the meshing.
+//
+// Snapshots are passed between the two threads through atomic pointers and
+// each one is owned by a single thread at any time: the worker while it
+// fills one, the owner from latest() on. The owner's previous snapshot goes
+// back to the worker, whose next mesh reuses its memory.
+struct MeshWorker {
+	// the grid has to stay the same while the worker exists
+	Slice<const float> voxels;
+	Vec3i size;
+	const BrickPyramid *pyramid;
+
+	NG_DELETE_COPY_AND_MOVE(MeshWorker);
+
+	MeshWorker(Slice<const float> voxels, const Vec3i &size,
+		const BrickPyramid *pyramid = nullptr);
+	~MeshWorker();
+
+	// Meshes the grid with the given settings once the worker is done with
+	// the mesh it's making. A request that's still waiting is replaced. The
+	// thread is started by the first call.
+	void request(MeshType type, NormalMode normals);
+
+	// Most recent snapshot, nullptr until the first one is done. Valid until
+	// the next call. Only the thread owning the worker may call it.
+	const MeshSnapshot *latest();
+
+	// everything below is private to the worker
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool has_request = false;
+	bool quit = false;
+	MeshType requested_type = MT_MARCHING_CUBES;
+	NormalMode requested_normals = NM_FACES;
+
+	// finished, not taken by latest() yet
+	std::atomic<MeshSnapshot*> published;
+	// given back by latest(), for the worker to reuse
+	std::atomic<MeshSnapshot*> recycled;
+	// the owner's, returned by latest()
+	MeshSnapshot *current = nullptr;
+
+	// the worker thread's
+	MeshContext context;
+	uint64_t revisions = 0;
+};
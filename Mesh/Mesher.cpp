@@ -0,0 +1,1442 @@
+#include "Mesh/Mesher.h"
+#include "Mesh/MeshContext.h"
+#include "Mesh/SignVolume.h"
+#include "Mesh/SparseVolume.h"
+#include "Core/Parallel.h"
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <unordered_map>
+
+static const uint64_t marching_cube_tris[256] = {
+	0ULL, 33793ULL, 36945ULL, 159668546ULL,
+	18961ULL, 144771090ULL, 5851666ULL, 595283255635ULL,
+	20913ULL, 67640146ULL, 193993474ULL, 655980856339ULL,
+	88782242ULL, 736732689667ULL, 797430812739ULL, 194554754ULL,
+	26657ULL, 104867330ULL, 136709522ULL, 298069416227ULL,
+	109224258ULL, 8877909667ULL, 318136408323ULL, 1567994331701604ULL,
+	189884450ULL, 350847647843ULL, 559958167731ULL, 3256298596865604ULL,
+	447393122899ULL, 651646838401572ULL, 2538311371089956ULL, 737032694307ULL,
+	29329ULL, 43484162ULL, 91358498ULL, 374810899075ULL,
+	158485010ULL, 178117478419ULL, 88675058979ULL, 433581536604804ULL,
+	158486962ULL, 649105605635ULL, 4866906995ULL, 3220959471609924ULL,
+	649165714851ULL, 3184943915608436ULL, 570691368417972ULL, 595804498035ULL,
+	124295042ULL, 431498018963ULL, 508238522371ULL, 91518530ULL,
+	318240155763ULL, 291789778348404ULL, 1830001131721892ULL, 375363605923ULL,
+	777781811075ULL, 1136111028516116ULL, 3097834205243396ULL, 508001629971ULL,
+	2663607373704004ULL, 680242583802939237ULL, 333380770766129845ULL, 179746658ULL,
+	42545ULL, 138437538ULL, 93365810ULL, 713842853011ULL,
+	73602098ULL, 69575510115ULL, 23964357683ULL, 868078761575828ULL,
+	28681778ULL, 713778574611ULL, 250912709379ULL, 2323825233181284ULL,
+	302080811955ULL, 3184439127991172ULL, 1694042660682596ULL, 796909779811ULL,
+	176306722ULL, 150327278147ULL, 619854856867ULL, 1005252473234484ULL,
+	211025400963ULL, 36712706ULL, 360743481544788ULL, 150627258963ULL,
+	117482600995ULL, 1024968212107700ULL, 2535169275963444ULL, 4734473194086550421ULL,
+	628107696687956ULL, 9399128243ULL, 5198438490361643573ULL, 194220594ULL,
+	104474994ULL, 566996932387ULL, 427920028243ULL, 2014821863433780ULL,
+	492093858627ULL, 147361150235284ULL, 2005882975110676ULL, 9671606099636618005ULL,
+	777701008947ULL, 3185463219618820ULL, 482784926917540ULL, 2900953068249785909ULL,
+	1754182023747364ULL, 4274848857537943333ULL, 13198752741767688709ULL, 2015093490989156ULL,
+	591272318771ULL, 2659758091419812ULL, 1531044293118596ULL, 298306479155ULL,
+	408509245114388ULL, 210504348563ULL, 9248164405801223541ULL, 91321106ULL,
+	2660352816454484ULL, 680170263324308757ULL, 8333659837799955077ULL, 482966828984116ULL,
+	4274926723105633605ULL, 3184439197724820ULL, 192104450ULL, 15217ULL,
+	45937ULL, 129205250ULL, 129208402ULL, 529245952323ULL,
+	169097138ULL, 770695537027ULL, 382310500883ULL, 2838550742137652ULL,
+	122763026ULL, 277045793139ULL, 81608128403ULL, 1991870397907988ULL,
+	362778151475ULL, 2059003085103236ULL, 2132572377842852ULL, 655681091891ULL,
+	58419234ULL, 239280858627ULL, 529092143139ULL, 1568257451898804ULL,
+	447235128115ULL, 679678845236084ULL, 2167161349491220ULL, 1554184567314086709ULL,
+	165479003923ULL, 1428768988226596ULL, 977710670185060ULL, 10550024711307499077ULL,
+	1305410032576132ULL, 11779770265620358997ULL, 333446212255967269ULL, 978168444447012ULL,
+	162736434ULL, 35596216627ULL, 138295313843ULL, 891861543990356ULL,
+	692616541075ULL, 3151866750863876ULL, 100103641866564ULL, 6572336607016932133ULL,
+	215036012883ULL, 726936420696196ULL, 52433666ULL, 82160664963ULL,
+	2588613720361524ULL, 5802089162353039525ULL, 214799000387ULL, 144876322ULL,
+	668013605731ULL, 110616894681956ULL, 1601657732871812ULL, 430945547955ULL,
+	3156382366321172ULL, 7644494644932993285ULL, 3928124806469601813ULL, 3155990846772900ULL,
+	339991010498708ULL, 10743689387941597493ULL, 5103845475ULL, 105070898ULL,
+	3928064910068824213ULL, 156265010ULL, 1305138421793636ULL, 27185ULL,
+	195459938ULL, 567044449971ULL, 382447549283ULL, 2175279159592324ULL,
+	443529919251ULL, 195059004769796ULL, 2165424908404116ULL, 1554158691063110021ULL,
+	504228368803ULL, 1436350466655236ULL, 27584723588724ULL, 1900945754488837749ULL,
+	122971970ULL, 443829749251ULL, 302601798803ULL, 108558722ULL,
+	724700725875ULL, 43570095105972ULL, 2295263717447940ULL, 2860446751369014181ULL,
+	2165106202149444ULL, 69275726195ULL, 2860543885641537797ULL, 2165106320445780ULL,
+	2280890014640004ULL, 11820349930268368933ULL, 8721082628082003989ULL, 127050770ULL,
+	503707084675ULL, 122834978ULL, 2538193642857604ULL, 10129ULL,
+	801441490467ULL, 2923200302876740ULL, 1443359556281892ULL, 2901063790822564949ULL,
+	2728339631923524ULL, 7103874718248233397ULL, 12775311047932294245ULL, 95520290ULL,
+	2623783208098404ULL, 1900908618382410757ULL, 137742672547ULL, 2323440239468964ULL,
+	362478212387ULL, 727199575803140ULL, 73425410ULL, 34337ULL,
+	163101314ULL, 668566030659ULL, 801204361987ULL, 73030562ULL,
+	591509145619ULL, 162574594ULL, 100608342969108ULL, 5553ULL,
+	724147968595ULL, 1436604830452292ULL, 176259090ULL, 42001ULL,
+	143955266ULL, 2385ULL, 18433ULL, 0ULL,
+};
+
+static void triangle(Mesh *mesh, int a, int b, int c)
+{
+	Vertex &va = mesh->vertices[a];
+	Vertex &vb = mesh->vertices[b];
+	Vertex &vc = mesh->vertices[c];
+	const Vec3f ab = va.position - vb.position;
+	const Vec3f cb = vc.position - vb.position;
+	const Vec3f n = cross(cb, ab);
+	va.normal += n;
+	vb.normal += n;
+	vc.normal += n;
+}
+
+// The meshers write vertices in the format of the mesh they're given. Packed
+// meshes are only written directly with gradient normals, face normals are
+// summed on an unpacked mesh which is packed afterwards (see generate_mesh).
+static inline Vertex make_vertex(const Mesh*, const Vec3f &position, const Vec3f &normal)
+{
+	return {position, normal};
+}
+
+static inline PackedVertex make_vertex(const PackedMesh *mesh, const Vec3f &position,
+	const Vec3f &normal)
+{
+	// the step is a power of two, dividing by it is exact
+	const Vec3f p = position / Vec3f(mesh->step) + Vec3f(0.5f);
+	return {Vec3us(p.x, p.y, p.z), encode_octahedral(normal)};
+}
+
+static void triangle(PackedMesh*, int, int, int) { NG_ASSERT(false); }
+
+template <typename M>
+static void quad(M *mesh, bool flip, bool face_normals, int ia, int ib, int ic, int id)
+{
+	if (flip)
+		std::swap(ib, id);
+
+	mesh->indices.append(ia);
+	mesh->indices.append(ib);
+	mesh->indices.append(ic);
+
+	mesh->indices.append(ia);
+	mesh->indices.append(ic);
+	mesh->indices.append(id);
+
+	if (!face_normals)
+		return;
+
+	triangle(mesh, ia, ib, ic);
+	triangle(mesh, ia, ic, id);
+}
+
+static bool layer_active(const BrickPyramid *pyramid, const Vec3i &size, int z)
+{
+	if (!pyramid)
+		return true;
+	return pyramid->active({0, 0, z}, {size.x-2, size.y-2, z});
+}
+
+// Exact amount of geometry a mesher is going to produce, counted from the
+// sign bits before meshing, so that the mesh is allocated only once.
+struct MeshCount {
+	int vertices = 0;
+	int indices = 0;
+};
+
+// Calls f(&count, p, config) for every cell with a surface crossing in layers
+// [z0, z1), the same cells the meshers visit.
+template <typename F>
+static MeshCount count_cells(const SignVolume &signs, const BrickPyramid *pyramid,
+	int z0, int z1, F &&f)
+{
+	MeshCount count;
+	const Vec3i &size = signs.size;
+	for (int z = z0; z < z1; z++) {
+		if (!layer_active(pyramid, size, z))
+			continue;
+	for (int y = 0; y < size.y-1; y++) {
+	for_each_active_config(signs, y, z, [&](int x, int config) {
+		f(&count, Vec3i(x, y, z), config);
+	});
+	}}
+	return count;
+}
+
+// Number of edges of a cell with a surface crossing. An edge is picked by the
+// bit of the corner it goes out of: x edges are bits 0, 2, 4, 6 of 'x_mask',
+// y edges bits 0, 1, 4, 5 of 'y_mask' and z edges bits 0-3 of 'z_mask'.
+static int crossing_edges(int config, int x_mask = 0x55, int y_mask = 0x33,
+	int z_mask = 0x0F)
+{
+	return __builtin_popcount((config ^ config >> 1) & x_mask) +
+		__builtin_popcount((config ^ config >> 2) & y_mask) +
+		__builtin_popcount((config ^ config >> 4) & z_mask);
+}
+
+static int cell_indices(int config)
+{
+	return (marching_cube_tris[config] & 0xF) * 3;
+}
+
+template <typename M>
+static void reserve_geometry(M *mesh, const MeshCount &count)
+{
+	mesh->vertices.reserve(mesh->vertices.length() + count.vertices);
+	mesh->indices.reserve(mesh->indices.length() + count.indices);
+}
+
+static void normalize_normals(Mesh *mesh, int first_vertex)
+{
+	// cheap per vertex, only large meshes are worth splitting
+	parallel_for(mesh->vertices.sub(first_vertex), 16384, [](Slice<Vertex> vertices) {
+		for (Vertex &v : vertices)
+			v.normal = normalize(v.normal);
+	});
+}
+
+static void normalize_normals(PackedMesh*, int) { NG_ASSERT(false); }
+
+// central differences, one-sided on the faces of the grid
+template <typename T>
+static Vec3f voxel_gradient(Slice<const T> voxels, const Vec3i &size, const Vec3i &p)
+{
+	if (p > Vec3i(0) && p < size - Vec3i(1)) {
+		const T *v = voxels.data + offset_3d(p, size);
+		const int sy = size.x;
+		const int64_t sz = int64_t(size.x) * size.y;
+		return Vec3f(
+			decode_sample(v[1])  - decode_sample(v[-1]),
+			decode_sample(v[sy]) - decode_sample(v[-sy]),
+			decode_sample(v[sz]) - decode_sample(v[-sz])) * Vec3f(0.5f);
+	}
+
+	Vec3f g;
+	for (int axis = 0; axis < 3; axis++) {
+		Vec3i a = p;
+		Vec3i b = p;
+		if (a[axis] > 0)
+			a[axis]--;
+		if (b[axis] < size[axis]-1)
+			b[axis]++;
+		const float va = decode_sample(voxels[offset_3d(a, size)]);
+		const float vb = decode_sample(voxels[offset_3d(b, size)]);
+		g[axis] = (vb - va) / (b[axis] - a[axis]);
+	}
+	return g;
+}
+
+// gradients at the corners of cell 'p', in the order of the corner samples
+template <typename T>
+static void corner_gradients(Vec3f *out, Slice<const T> voxels, const Vec3i &size,
+	const Vec3i &p)
+{
+	for (int i = 0; i < 8; i++)
+		out[i] = voxel_gradient(voxels, size, p + Vec3i(i & 1, (i >> 1) & 1, (i >> 2) & 1));
+}
+
+// Normal of the vertex on an edge along 'axis', the gradients at both ends
+// are interpolated the same way the position is. The field grows towards the
+// outside, so the gradient points out of the surface.
+static Vec3f edge_normal(const Vec3f &ga, const Vec3f &gb, int axis, float va, float vb)
+{
+	Vec3f g = lerp(ga, gb, va / (va - vb));
+	if (length2(g) == 0.0f) {
+		// flat field around the edge, the edge itself still has a direction
+		g = Vec3f(0);
+		g[axis] = va < 0.0f ? 1.0f : -1.0f;
+	}
+	return normalize(g);
+}
+
+template <typename M, typename T>
+static void flat_marching_cubes(M *mesh, Slice<const T> voxels, const Vec3i &size,
+	const BrickPyramid *pyramid, MeshContext *ctx)
+{
+	NG_ASSERT(voxels.length == volume(size));
+	const int first_vertex = mesh->vertices.length();
+	const bool face_normals = ctx->normals == NM_FACES;
+	SignVolume &signs = ctx->signs;
+	signs.build(voxels, size, pyramid);
+	reserve_geometry(mesh, count_cells(signs, pyramid, 0, size.z-1,
+		[](MeshCount *c, const Vec3i&, int config) {
+			c->vertices += crossing_edges(config);
+			c->indices += cell_indices(config);
+		}));
+
+	for (int z = 0; z < size.z-1; z++) {
+		if (!layer_active(pyramid, size, z))
+			continue;
+	for (int y = 0; y < size.y-1; y++) {
+	for_each_active_cell(signs, voxels, y, z, [&](int x, int config_n) {
+		const float vs[8] = {
+			decode_sample(voxels[offset_3d({x,   y,   z},   size)]),
+			decode_sample(voxels[offset_3d({x+1, y,   z},   size)]),
+			decode_sample(voxels[offset_3d({x,   y+1, z},   size)]),
+			decode_sample(voxels[offset_3d({x+1, y+1, z},   size)]),
+			decode_sample(voxels[offset_3d({x,   y,   z+1}, size)]),
+			decode_sample(voxels[offset_3d({x+1, y,   z+1}, size)]),
+			decode_sample(voxels[offset_3d({x,   y+1, z+1}, size)]),
+			decode_sample(voxels[offset_3d({x+1, y+1, z+1}, size)]),
+		};
+
+		Vec3f gs[8];
+		if (!face_normals)
+			corner_gradients(gs, voxels, size, Vec3i(x, y, z));
+
+		int edge_indices[12];
+		auto do_edge = [&](int n_edge, int a, int b, int axis, const Vec3f &base) {
+			const float va = vs[a];
+			const float vb = vs[b];
+			if ((va < 0.0) == (vb < 0.0))
+				return;
+
+			Vec3f v = base;
+			v[axis] += va / (va - vb);
+			const Vec3f n = face_normals ? Vec3f(0) : edge_normal(gs[a], gs[b], axis, va, vb);
+			edge_indices[n_edge] = mesh->vertices.length();
+			mesh->vertices.append(make_vertex(mesh, v, n));
+		};
+
+		do_edge(0,  0, 1, 0, Vec3f(x, y,   z));
+		do_edge(1,  2, 3, 0, Vec3f(x, y+1, z));
+		do_edge(2,  4, 5, 0, Vec3f(x, y,   z+1));
+		do_edge(3,  6, 7, 0, Vec3f(x, y+1, z+1));
+
+		do_edge(4,  0, 2, 1, Vec3f(x,   y, z));
+		do_edge(5,  1, 3, 1, Vec3f(x+1, y, z));
+		do_edge(6,  4, 6, 1, Vec3f(x,   y, z+1));
+		do_edge(7,  5, 7, 1, Vec3f(x+1, y, z+1));
+
+		do_edge(8,  0, 4, 2, Vec3f(x,   y,   z));
+		do_edge(9,  1, 5, 2, Vec3f(x+1, y,   z));
+		do_edge(10, 2, 6, 2, Vec3f(x,   y+1, z));
+		do_edge(11, 3, 7, 2, Vec3f(x+1, y+1, z));
+
+		const uint64_t config = marching_cube_tris[config_n];
+		const int n_triangles = config & 0xF;
+		const int n_indices = n_triangles * 3;
+		const int index_base = mesh->indices.length();
+
+		int offset = 4;
+		for (int i = 0; i < n_indices; i++) {
+			const int edge = (config >> offset) & 0xF;
+			mesh->indices.append(edge_indices[edge]);
+			offset += 4;
+		}
+		if (!face_normals)
+			return;
+		for (int i = 0; i < n_triangles; i++) {
+			triangle(mesh,
+				mesh->indices[index_base+i*3+0],
+				mesh->indices[index_base+i*3+1],
+				mesh->indices[index_base+i*3+2]);
+		}
+	});
+	}}
+	if (face_normals)
+		normalize_normals(mesh, first_vertex);
+}
+
+// Per-slab state of the smooth marching cubes mesher. Slabs are counted
+// first, so every slab knows where its vertices and indices go and writes
+// them straight into the mesh. The serial path is a single slab, the parallel
+// path meshes several of them at once.
+//
+// Vertices on the first z layer of a slab (except the very first one) are
+// owned by the previous slab. The slab recomputes them as ghosts and refers
+// to them with negative indices (-1 - ghost), which are resolved once the
+// previous slab is done. Face normal contributions to ghosts are logged in
+// order and replayed on the owners, so the result is exactly the same as the
+// serial one.
+struct SmoothGhostNormal {
+	int ghost;
+	Vec3f normal;
+};
+
+template <typename M>
+struct SmoothSlab {
+	int z0 = 0;
+	int z1 = 0;
+	M *mesh = nullptr;
+	SlabRing<Vec3i> *edges = nullptr;
+	bool face_normals = true;
+	MeshCount count;
+	int vertex_base = 0;
+	int index_base = 0;
+	Vector<Vertex> ghosts;
+	Vector<int> ghost_slots;
+	Vector<SmoothGhostNormal> ghost_normals;
+
+	// used by the parallel path only, positions of the indices referring to
+	// ghosts
+	Vector<int> ghost_refs;
+	SlabRing<Vec3i> own_edges;
+};
+
+// A shared vertex is made by the first cell which touches its edge, that is
+// the edges on the low faces of the grid (or the slab) belong to the cells
+// next to them, every other edge to the cell it's the far edge of.
+static MeshCount count_smooth_slab(const SignVolume &signs, const BrickPyramid *pyramid,
+	int z0, int z1)
+{
+	return count_cells(signs, pyramid, z0, z1, [](MeshCount *c, const Vec3i &p, int config) {
+		const bool lx = p.x == 0;
+		const bool ly = p.y == 0;
+		const bool lz = p.z == 0;
+		c->vertices += crossing_edges(config,
+			0x40 | lz << 2 | ly << 4 | (ly && lz),
+			0x20 | lz << 1 | lx << 4 | (lx && lz),
+			0x08 | ly << 1 | lx << 2 | (lx && ly));
+		c->indices += cell_indices(config);
+	});
+}
+
+static inline Vertex &slab_vertex(SmoothSlab<Mesh> *slab, int idx)
+{
+	if (idx < 0)
+		return slab->ghosts[-1 - idx];
+	return slab->mesh->vertices[idx];
+}
+
+static void slab_triangle(SmoothSlab<Mesh> *slab, int a, int b, int c)
+{
+	Vertex &va = slab_vertex(slab, a);
+	Vertex &vb = slab_vertex(slab, b);
+	Vertex &vc = slab_vertex(slab, c);
+	const Vec3f ab = va.position - vb.position;
+	const Vec3f cb = vc.position - vb.position;
+	const Vec3f n = cross(cb, ab);
+	const int ids[3] = {a, b, c};
+	Vertex *vs[3] = {&va, &vb, &vc};
+	for (int i = 0; i < 3; i++) {
+		if (ids[i] < 0)
+			slab->ghost_normals.append({-1 - ids[i], n});
+		else
+			vs[i]->normal += n;
+	}
+}
+
+static void slab_triangle(SmoothSlab<PackedMesh>*, int, int, int) { NG_ASSERT(false); }
+
+template <typename M, typename T>
+static void smooth_slab_ghosts(SmoothSlab<M> *slab, Slice<const T> voxels, const Vec3i &size)
+{
+	const int z = slab->z0;
+	for (int y = 0; y < size.y; y++) {
+	for (int x = 0; x < size.x; x++) {
+		const Vec3i p(x, y, z);
+		const float va = decode_sample(voxels[offset_3d(p, size)]);
+		for (int axis = 0; axis < 2; axis++) {
+			Vec3i q = p;
+			q[axis]++;
+			if (q[axis] == size[axis])
+				continue;
+
+			const float vb = decode_sample(voxels[offset_3d(q, size)]);
+			if ((va < 0.0) == (vb < 0.0))
+				continue;
+
+			Vec3f v = ToVec3f(p);
+			v[axis] += va / (va - vb);
+			const int slot = offset_3d_slab(p, size);
+			(*slab->edges)[p][axis] = -1 - slab->ghosts.length();
+			slab->ghosts.append({v, Vec3f(0)});
+			slab->ghost_slots.append(slot * 3 + axis);
+		}
+	}}
+}
+
+// Expects the mesh to be resized to fit the slab's count already.
+template <typename M, typename T>
+static void smooth_slab(SmoothSlab<M> *slab, const SignVolume &signs,
+	const BrickPyramid *pyramid, Slice<const T> voxels, const Vec3i &size)
+{
+	auto *vertices = slab->mesh->vertices.data();
+	int *indices = slab->mesh->indices.data();
+	int n_vertices = slab->vertex_base;
+	int n_indices = slab->index_base;
+	SlabRing<Vec3i> &edges = *slab->edges;
+	edges.resize(size);
+	if (slab->z0 > 0)
+		smooth_slab_ghosts(slab, voxels, size);
+
+	for (int z = slab->z0; z < slab->z1; z++) {
+		if (!layer_active(pyramid, size, z))
+			continue;
+	for (int y = 0; y < size.y-1; y++) {
+	for_each_active_cell(signs, voxels, y, z, [&](int x, int config_n) {
+		const Vec3i p(x, y, z);
+		const float vs[8] = {
+			decode_sample(voxels[offset_3d({x,   y,   z},   size)]),
+			decode_sample(voxels[offset_3d({x+1, y,   z},   size)]),
+			decode_sample(voxels[offset_3d({x,   y+1, z},   size)]),
+			decode_sample(voxels[offset_3d({x+1, y+1, z},   size)]),
+			decode_sample(voxels[offset_3d({x,   y,   z+1}, size)]),
+			decode_sample(voxels[offset_3d({x+1, y,   z+1}, size)]),
+			decode_sample(voxels[offset_3d({x,   y+1, z+1}, size)]),
+			decode_sample(voxels[offset_3d({x+1, y+1, z+1}, size)]),
+		};
+
+		auto do_edge = [&](float va, float vb, int axis, const Vec3i &p) {
+			if ((va < 0.0) == (vb < 0.0))
+				return;
+
+			Vec3f v = ToVec3f(p);
+			v[axis] += va / (va - vb);
+			Vec3f n(0);
+			if (!slab->face_normals) {
+				Vec3i q = p;
+				q[axis]++;
+				n = edge_normal(voxel_gradient(voxels, size, p),
+					voxel_gradient(voxels, size, q), axis, va, vb);
+			}
+			edges[p][axis] = n_vertices;
+			vertices[n_vertices++] = make_vertex(slab->mesh, v, n);
+		};
+
+		if (p.y == 0 && p.z == 0)
+			do_edge(vs[0], vs[1], 0, Vec3i(x, y,   z));
+		if (p.z == 0)
+			do_edge(vs[2], vs[3], 0, Vec3i(x, y+1, z));
+		if (p.y == 0)
+			do_edge(vs[4], vs[5], 0, Vec3i(x, y,   z+1));
+		do_edge(vs[6], vs[7], 0, Vec3i(x, y+1, z+1));
+
+		if (p.x == 0 && p.z == 0)
+			do_edge(vs[0], vs[2], 1, Vec3i(x,   y, z));
+		if (p.z == 0)
+			do_edge(vs[1], vs[3], 1, Vec3i(x+1, y, z));
+		if (p.x == 0)
+			do_edge(vs[4], vs[6], 1, Vec3i(x,   y, z+1));
+		do_edge(vs[5], vs[7], 1, Vec3i(x+1, y, z+1));
+
+		if (p.x == 0 && p.y == 0)
+			do_edge(vs[0], vs[4], 2, Vec3i(x,   y,   z));
+		if (p.y == 0)
+			do_edge(vs[1], vs[5], 2, Vec3i(x+1, y,   z));
+		if (p.x == 0)
+			do_edge(vs[2], vs[6], 2, Vec3i(x,   y+1, z));
+		do_edge(vs[3], vs[7], 2, Vec3i(x+1, y+1, z));
+
+		int edge_indices[12];
+		edge_indices[0]  = edges[{p.x, p.y,   p.z  }].x;
+		edge_indices[1]  = edges[{p.x, p.y+1, p.z  }].x;
+		edge_indices[2]  = edges[{p.x, p.y,   p.z+1}].x;
+		edge_indices[3]  = edges[{p.x, p.y+1, p.z+1}].x;
+		edge_indices[4]  = edges[{p.x,   p.y, p.z  }].y;
+		edge_indices[5]  = edges[{p.x+1, p.y, p.z  }].y;
+		edge_indices[6]  = edges[{p.x,   p.y, p.z+1}].y;
+		edge_indices[7]  = edges[{p.x+1, p.y, p.z+1}].y;
+		edge_indices[8]  = edges[{p.x,   p.y,   p.z}].z;
+		edge_indices[9]  = edges[{p.x+1, p.y,   p.z}].z;
+		edge_indices[10] = edges[{p.x,   p.y+1, p.z}].z;
+		edge_indices[11] = edges[{p.x+1, p.y+1, p.z}].z;
+
+		const uint64_t config = marching_cube_tris[config_n];
+		const int n_triangles = config & 0xF;
+		const int n_indices_cell = n_triangles * 3;
+		const int index_base = n_indices;
+
+		int offset = 4;
+		for (int i = 0; i < n_indices_cell; i++) {
+			const int idx = edge_indices[(config >> offset) & 0xF];
+			if (idx < 0)
+				slab->ghost_refs.append(n_indices);
+			indices[n_indices++] = idx;
+			offset += 4;
+		}
+		if (!slab->face_normals)
+			return;
+		for (int i = 0; i < n_triangles; i++) {
+			slab_triangle(slab,
+				indices[index_base+i*3+0],
+				indices[index_base+i*3+1],
+				indices[index_base+i*3+2]);
+		}
+	});
+	}}
+	NG_ASSERT(n_vertices == slab->vertex_base + slab->count.vertices);
+	NG_ASSERT(n_indices == slab->index_base + slab->count.indices);
+}
+
+template <typename M, typename T>
+static void smooth_marching_cubes(M *mesh, Slice<const T> voxels, const Vec3i &size,
+	const BrickPyramid *pyramid, MeshContext *ctx)
+{
+	NG_ASSERT(voxels.length == volume(size));
+	const int first_vertex = mesh->vertices.length();
+
+	SignVolume &signs = ctx->signs;
+	signs.build(voxels, size, pyramid);
+
+	SmoothSlab<M> slab;
+	slab.z0 = 0;
+	slab.z1 = size.z-1;
+	slab.mesh = mesh;
+	slab.edges = &ctx->edges;
+	slab.face_normals = ctx->normals == NM_FACES;
+	slab.count = count_smooth_slab(signs, pyramid, slab.z0, slab.z1);
+	slab.vertex_base = first_vertex;
+	slab.index_base = mesh->indices.length();
+	mesh->vertices.resize(slab.vertex_base + slab.count.vertices);
+	mesh->indices.resize(slab.index_base + slab.count.indices);
+	smooth_slab(&slab, signs, pyramid, voxels, size);
+	if (slab.face_normals)
+		normalize_normals(mesh, first_vertex);
+}
+
+// Runs f(0) .. f(n-1) as tasks of the default scheduler, f(0) on the
+// calling thread.
+template <typename F>
+static void run_parallel(int n, F &&f)
+{
+	TaskGroup group;
+	for (int i = 1; i < n; i++)
+		group.run([&f, i] { f(i); });
+	f(0);
+	group.wait();
+}
+
+template <typename T>
+static void smooth_marching_cubes_parallel(Mesh *mesh, Slice<const T> voxels,
+	const Vec3i &size, int num_threads, const BrickPyramid *pyramid, MeshContext *ctx)
+{
+	NG_ASSERT(voxels.length == volume(size));
+	if (num_threads <= 0)
+		num_threads = default_scheduler()->num_workers() + 1;
+
+	// a few slabs per thread to even out the load, but not thinner than a
+	// couple of layers, otherwise ghosts start to dominate
+	const int n_layers = size.z-1;
+	const int n_slabs = clamp(num_threads * 4, 1, std::max(1, n_layers / 2));
+	num_threads = std::min(num_threads, n_slabs);
+	if (num_threads == 1) {
+		smooth_marching_cubes(mesh, voxels, size, pyramid, ctx);
+		return;
+	}
+
+	Vector<SmoothSlab<Mesh>> slabs(n_slabs);
+	for (int i = 0; i < n_slabs; i++) {
+		SmoothSlab<Mesh> &s = slabs[i];
+		s.z0 = n_layers * i / n_slabs;
+		s.z1 = n_layers * (i+1) / n_slabs;
+		s.mesh = mesh;
+		s.edges = &s.own_edges;
+		s.face_normals = ctx->normals == NM_FACES;
+	}
+
+	SignVolume &signs = ctx->signs;
+	signs.resize(size);
+
+	std::atomic<int> next_slab(0);
+	run_parallel(num_threads, [&](int) {
+		for (int i = next_slab++; i < n_slabs; i = next_slab++) {
+			const int z1 = i == n_slabs-1 ? size.z : slabs[i].z1;
+			signs.build(voxels, slabs[i].z0, z1, pyramid);
+		}
+	});
+
+	// counting needs the sign bits of the next slab's first layer, so it
+	// can't be done while building them
+	next_slab = 0;
+	run_parallel(num_threads, [&](int) {
+		for (int i = next_slab++; i < n_slabs; i = next_slab++)
+			slabs[i].count = count_smooth_slab(signs, pyramid, slabs[i].z0, slabs[i].z1);
+	});
+
+	// slabs are laid out one after another, the order of vertices and
+	// indices is the order the serial mesher would produce
+	int n_vertices = mesh->vertices.length();
+	int n_indices = mesh->indices.length();
+	for (SmoothSlab<Mesh> &s : slabs) {
+		s.vertex_base = n_vertices;
+		s.index_base = n_indices;
+		n_vertices += s.count.vertices;
+		n_indices += s.count.indices;
+	}
+	mesh->vertices.resize(n_vertices);
+	mesh->indices.resize(n_indices);
+
+	next_slab = 0;
+	run_parallel(num_threads, [&](int) {
+		for (int i = next_slab++; i < n_slabs; i = next_slab++)
+			smooth_slab(&slabs[i], signs, pyramid, voxels, size);
+	});
+
+	auto ghost_owner = [&](int slab, int ghost) {
+		const int slot = slabs[slab].ghost_slots[ghost];
+		return slabs[slab-1].own_edges.slots[slot / 3][slot % 3];
+	};
+
+	// normal contributions across slab boundaries, these have to go in slab
+	// order to match the serial float summation
+	const bool face_normals = ctx->normals == NM_FACES;
+	if (face_normals) {
+		for (int i = 1; i < n_slabs; i++) {
+			for (const SmoothGhostNormal &gn : slabs[i].ghost_normals)
+				mesh->vertices[ghost_owner(i, gn.ghost)].normal += gn.normal;
+		}
+	}
+
+	next_slab = 0;
+	run_parallel(num_threads, [&](int) {
+		for (int i = next_slab++; i < n_slabs; i = next_slab++) {
+			const SmoothSlab<Mesh> &s = slabs[i];
+			int *indices = mesh->indices.data();
+			for (int pos : s.ghost_refs)
+				indices[pos] = ghost_owner(i, -1 - indices[pos]);
+
+			if (!face_normals)
+				continue;
+			const int end = s.vertex_base + s.count.vertices;
+			for (Vertex &v : mesh->vertices.sub(s.vertex_base, end))
+				v.normal = normalize(v.normal);
+		}
+	});
+}
+
+// Cells before 'quad_min' only contribute vertices, the quads they'd make are
+// produced by whoever meshes the neighbouring part of the volume.
+template <typename M, typename T>
+static void naive_surface_nets(M *mesh, Slice<const T> voxels, const Vec3i &size,
+	const BrickPyramid *pyramid, const Vec3i &quad_min, MeshContext *ctx)
+{
+	NG_ASSERT(voxels.length == volume(size));
+	const int first_vertex = mesh->vertices.length();
+	SignVolume &signs = ctx->signs;
+	signs.build(voxels, size, pyramid);
+	SlabRing<int> &cells = ctx->cells;
+	cells.resize(size);
+	const bool face_normals = ctx->normals == NM_FACES;
+
+	// a vertex per cell, a quad per crossing edge going out of its first
+	// corner which has cells behind it
+	reserve_geometry(mesh, count_cells(signs, pyramid, 0, size.z-1,
+		[&](MeshCount *c, const Vec3i &p, int config) {
+			c->vertices++;
+			if (!(p >= quad_min))
+				return;
+			const int quads =
+				(p.y > 0 && p.z > 0 && ((config ^ config >> 1) & 1)) +
+				(p.x > 0 && p.z > 0 && ((config ^ config >> 2) & 1)) +
+				(p.x > 0 && p.y > 0 && ((config ^ config >> 4) & 1));
+			c->indices += quads * 6;
+		}));
+
+	for (int z = 0; z < size.z-1; z++) {
+		if (!layer_active(pyramid, size, z))
+			continue;
+	for (int y = 0; y < size.y-1; y++) {
+	for_each_active_cell(signs, voxels, y, z, [&](int x, int config_n) {
+		const Vec3i p(x, y, z);
+		const float vs[8] = {
+			decode_sample(voxels[offset_3d({x,   y,   z},   size)]),
+			decode_sample(voxels[offset_3d({x+1, y,   z},   size)]),
+			decode_sample(voxels[offset_3d({x,   y+1, z},   size)]),
+			decode_sample(voxels[offset_3d({x+1, y+1, z},   size)]),
+			decode_sample(voxels[offset_3d({x,   y,   z+1}, size)]),
+			decode_sample(voxels[offset_3d({x+1, y,   z+1}, size)]),
+			decode_sample(voxels[offset_3d({x,   y+1, z+1}, size)]),
+			decode_sample(voxels[offset_3d({x+1, y+1, z+1}, size)]),
+		};
+
+		Vec3f gs[8];
+		if (!face_normals)
+			corner_gradients(gs, voxels, size, p);
+
+		Vec3f average(0);
+		Vec3f normal(0);
+		int average_n = 0;
+		auto do_edge = [&](int a, int b, int axis, const Vec3i &p) {
+			if (!((config_n >> a ^ config_n >> b) & 1))
+				return;
+
+			const float va = vs[a];
+			const float vb = vs[b];
+
+			Vec3f v = ToVec3f(p);
+			v[axis] += va / (va - vb);
+			average += v;
+			average_n++;
+			if (!face_normals)
+				normal += edge_normal(gs[a], gs[b], axis, va, vb);
+		};
+
+		do_edge(0, 1, 0, Vec3i(x, y,     z));
+		do_edge(2, 3, 0, Vec3i(x, y+1,   z));
+		do_edge(4, 5, 0, Vec3i(x, y,     z+1));
+		do_edge(6, 7, 0, Vec3i(x, y+1,   z+1));
+		do_edge(0, 2, 1, Vec3i(x,   y,   z));
+		do_edge(1, 3, 1, Vec3i(x+1, y,   z));
+		do_edge(4, 6, 1, Vec3i(x,   y,   z+1));
+		do_edge(5, 7, 1, Vec3i(x+1, y,   z+1));
+		do_edge(0, 4, 2, Vec3i(x,   y,   z));
+		do_edge(1, 5, 2, Vec3i(x+1, y,   z));
+		do_edge(2, 6, 2, Vec3i(x,   y+1, z));
+		do_edge(3, 7, 2, Vec3i(x+1, y+1, z));
+
+		const Vec3f v = average / Vec3f(average_n);
+		cells[p] = mesh->vertices.length();
+		mesh->vertices.append(make_vertex(mesh, v,
+			face_normals ? Vec3f(0) : normalize(normal)));
+
+		if (!(p >= quad_min))
+			return;
+
+		const bool flip = config_n & 1;
+		if (p.y > 0 && p.z > 0 && ((config_n ^ config_n >> 1) & 1)) {
+			quad(mesh, flip, face_normals,
+				cells[Vec3i(p.x, p.y,   p.z)],
+				cells[Vec3i(p.x, p.y,   p.z-1)],
+				cells[Vec3i(p.x, p.y-1, p.z-1)],
+				cells[Vec3i(p.x, p.y-1, p.z)]
+			);
+		}
+		if (p.x > 0 && p.z > 0 && ((config_n ^ config_n >> 2) & 1)) {
+			quad(mesh, flip, face_normals,
+				cells[Vec3i(p.x,   p.y, p.z)],
+				cells[Vec3i(p.x-1, p.y, p.z)],
+				cells[Vec3i(p.x-1, p.y, p.z-1)],
+				cells[Vec3i(p.x,   p.y, p.z-1)]
+			);
+		}
+		if (p.x > 0 && p.y > 0 && ((config_n ^ config_n >> 4) & 1)) {
+			quad(mesh, flip, face_normals,
+				cells[Vec3i(p.x,   p.y,   p.z)],
+				cells[Vec3i(p.x,   p.y-1, p.z)],
+				cells[Vec3i(p.x-1, p.y-1, p.z)],
+				cells[Vec3i(p.x-1, p.y,   p.z)]
+			);
+		}
+	});
+	}}
+	if (face_normals)
+		normalize_normals(mesh, first_vertex);
+}
+
+// Transition cells of the LOD mesher. The 3x3 fine samples of a face quad are
+// numbered i + 3*j, (i, j) being their position along the u and v axes of the
+// face in half strides, and a bit of a transition cell config is set if its
+// sample is inside. Edges 0-5 are the fine u edges ((i, j)-(i+1, j) is
+// j*2 + i), 6-11 the fine v edges ((i, j)-(i, j+1) is 6 + i*2 + j) and 12-15
+// the coarse edges on v = 0, v = 2, u = 0 and u = 2, from sample to sample.
+static const int transition_edge_samples[16][2] = {
+	{0, 1}, {1, 2}, {3, 4}, {4, 5}, {6, 7}, {7, 8},
+	{0, 3}, {3, 6}, {1, 4}, {4, 7}, {2, 5}, {5, 8},
+	{0, 2}, {6, 8}, {0, 6}, {2, 8},
+};
+
+struct TransitionCell {
+	int n_triangles;
+	uint8_t edges[14*3];
+};
+
+struct TransitionTable {
+	TransitionCell cells[512];
+};
+
+// The surface of a transition cell is made of loops, which run along the
+// fine surface's edge on the face, along the coarse one's and along the
+// sides of the quad between the two. Every loop is triangulated as a fan.
+//
+// Seen from outside the face, a marching cubes cell goes around its part of
+// the face with the inside on its right (and the table cuts an ambiguous face
+// so that both inside corners are cut off). The transition cell has to go
+// around both surface edges the other way than the cells next to it do: the
+// fine grid's cells see the face from the other side, so the transition cell
+// keeps the inside on the right of the fine segments and on the left of the
+// coarse ones.
+static TransitionTable build_transition_table()
+{
+	// in quarter strides, so that the middle of every edge is a whole point
+	auto sample_pos = [](int k) { return Vec2i(k % 3 * 2, k / 3 * 2); };
+	auto edge_pos = [](int e) {
+		const int a = transition_edge_samples[e][0];
+		const int b = transition_edge_samples[e][1];
+		return Vec2i(a % 3 + b % 3, a / 3 + b / 3);
+	};
+
+	// corners (0, 0), (1, 0), (0, 1), (1, 1) and edges v = 0, v = 1,
+	// u = 0, u = 1 of the fine quads and of the coarse one
+	static const int quads[5][2][4] = {
+		{{0, 1, 3, 4}, {0, 2, 6,  8}},
+		{{1, 2, 4, 5}, {1, 3, 8,  10}},
+		{{3, 4, 6, 7}, {2, 4, 7,  9}},
+		{{4, 5, 7, 8}, {3, 5, 9,  11}},
+		{{0, 2, 6, 8}, {12, 13, 14, 15}},
+	};
+	static const int corner_edges[4][2] = {{0, 2}, {0, 3}, {1, 2}, {1, 3}};
+	// the two fine edges and the coarse one on every side
+	static const int sides[4][3] = {{0, 1, 12}, {4, 5, 13}, {6, 7, 14}, {10, 11, 15}};
+
+	TransitionTable table;
+	for (int config = 0; config < 512; config++) {
+		auto inside = [config](int k) { return (config >> k & 1) != 0; };
+		auto crosses = [&](int e) {
+			return inside(transition_edge_samples[e][0]) != inside(transition_edge_samples[e][1]);
+		};
+
+		int next[16], prev[16];
+		for (int e = 0; e < 16; e++)
+			next[e] = prev[e] = -1;
+		auto link = [&](int a, int b) {
+			NG_ASSERT(next[a] == -1 && prev[b] == -1);
+			next[a] = b;
+			prev[b] = a;
+		};
+		auto segment = [&](int ea, int eb, bool inside_right) {
+			const int *s = transition_edge_samples[ea];
+			const Vec2i p = edge_pos(ea);
+			const Vec2i d = edge_pos(eb) - p;
+			const Vec2i o = sample_pos(inside(s[0]) ? s[0] : s[1]) - p;
+			if ((d.x * o.y - d.y * o.x < 0) == inside_right)
+				link(ea, eb);
+			else
+				link(eb, ea);
+		};
+
+		for (int q = 0; q < 5; q++) {
+			const int *corners = quads[q][0];
+			const int *edges = quads[q][1];
+			const bool fine = q < 4;
+			int crossing[4];
+			int n = 0;
+			for (int e = 0; e < 4; e++) {
+				if (crosses(edges[e]))
+					crossing[n++] = edges[e];
+			}
+			if (n == 2) {
+				segment(crossing[0], crossing[1], fine);
+			} else if (n == 4) {
+				for (int c = 0; c < 4; c++) {
+					if (inside(corners[c]))
+						segment(edges[corner_edges[c][0]], edges[corner_edges[c][1]], fine);
+				}
+			}
+		}
+		for (const int *side : sides) {
+			int ends[3];
+			int n = 0;
+			for (int k = 0; k < 3; k++) {
+				if (crosses(side[k]))
+					ends[n++] = side[k];
+			}
+			NG_ASSERT(n == 0 || n == 2);
+			if (n == 0)
+				continue;
+			if (next[ends[0]] == -1)
+				link(ends[0], ends[1]);
+			else
+				link(ends[1], ends[0]);
+		}
+
+		TransitionCell &cell = table.cells[config];
+		cell.n_triangles = 0;
+		bool visited[16] = {};
+		for (int start = 0; start < 16; start++) {
+			if (next[start] == -1 || visited[start])
+				continue;
+			int loop[16];
+			int n = 0;
+			int e = start;
+			do {
+				NG_ASSERT(next[e] != -1);
+				visited[e] = true;
+				loop[n++] = e;
+				e = next[e];
+			} while (e != start);
+
+			for (int i = 1; i+1 < n; i++) {
+				uint8_t *tri = cell.edges + cell.n_triangles++ * 3;
+				tri[0] = loop[0];
+				tri[1] = loop[i];
+				tri[2] = loop[i+1];
+			}
+		}
+	}
+	return table;
+}
+
+static const TransitionTable &transition_table()
+{
+	static const TransitionTable table = build_transition_table();
+	return table;
+}
+
+// A face of the grid with transition cells, its points are origin + u * e_u +
+// v * e_v, u x v points out of the grid.
+struct TransitionFace {
+	Vec3i origin;
+	int u_axis;
+	int v_axis;
+	// coarse quads along u and v
+	int u_quads;
+	int v_quads;
+};
+
+static TransitionFace transition_face(int face, const Vec3i &size, int stride)
+{
+	const int axis = face / 2;
+	const bool high = face & 1;
+	TransitionFace f;
+	f.origin = Vec3i(0);
+	f.origin[axis] = high ? size[axis]-1 : 0;
+	f.u_axis = (axis + (high ? 1 : 2)) % 3;
+	f.v_axis = (axis + (high ? 2 : 1)) % 3;
+	f.u_quads = (size[f.u_axis] - 1) / stride;
+	f.v_quads = (size[f.v_axis] - 1) / stride;
+	return f;
+}
+
+// Sample (u, v) of the fine grid of a face, in half strides.
+static Vec3i face_point(const TransitionFace &f, int u, int v, int half)
+{
+	Vec3i p = f.origin;
+	p[f.u_axis] += u * half;
+	p[f.v_axis] += v * half;
+	return p;
+}
+
+// The other face of the grid a fine edge of 'face' going out of 'p' along
+// 'axis' lies on, -1 if there's none. Such an edge is on one of the 12 edges
+// of the grid, shared by the transition cells of both faces.
+static int shared_face(int face, const Vec3i &p, int axis, const Vec3i &size)
+{
+	const int other = 3 - face / 2 - axis;
+	if (p[other] != 0 && p[other] != size[other]-1)
+		return -1;
+	return other * 2 + (p[other] != 0);
+}
+
+// corner of a cell each of its 12 edges goes out of, the edge is along
+// axis 'edge / 4'
+static const int cell_edge_corners[12] = {0, 2, 4, 6, 0, 1, 4, 5, 0, 1, 2, 3};
+
+template <typename T>
+static void lod_marching_cubes(Mesh *mesh, Slice<const T> voxels, const Vec3i &size,
+	int stride, int transition_faces, MeshContext *ctx)
+{
+	NG_ASSERT(voxels.length == volume(size));
+	NG_ASSERT(stride > 0);
+	NG_ASSERT(transition_faces == 0 || (stride >= 2 && stride % 2 == 0));
+	const Vec3i cells = (size - Vec3i(1)) / Vec3i(stride);
+	NG_ASSERT(cells * Vec3i(stride) == size - Vec3i(1));
+	const Vec3i n = cells + Vec3i(1);
+	const int half = stride / 2;
+	const int first_vertex = mesh->vertices.length();
+	const bool face_normals = ctx->normals == NM_FACES;
+	const TransitionTable &table = transition_table();
+
+	auto voxel = [&](const Vec3i &p) {
+		return decode_sample(voxels[offset_3d(p, size)]);
+	};
+	// the vertex on the edge going out of the voxel 'p' along 'axis', 'step'
+	// voxels long
+	auto edge_vertex = [&](const Vec3i &p, int axis, int step, float va, float vb) {
+		Vec3f v = ToVec3f(p);
+		v[axis] += va / (va - vb) * step;
+		Vec3f normal(0);
+		if (!face_normals || step != stride) {
+			Vec3i q = p;
+			q[axis] += step;
+			normal = edge_normal(voxel_gradient(voxels, size, p),
+				voxel_gradient(voxels, size, q), axis, va, vb);
+		}
+		mesh->vertices.append({v, normal});
+		return mesh->vertices.length() - 1;
+	};
+
+	Vector<float> &samples = ctx->lod_samples;
+	samples.resize(volume(n));
+	for (int z = 0; z < n.z; z++) {
+	for (int y = 0; y < n.y; y++) {
+	for (int x = 0; x < n.x; x++) {
+		samples[offset_3d({x, y, z}, n)] = voxel(Vec3i(x, y, z) * Vec3i(stride));
+	}}}
+	const float *s = samples.data();
+	const int sy = n.x;
+	const int sz = n.x * n.y;
+	const int axis_steps[3] = {1, sy, sz};
+	auto transition_config = [&](const TransitionFace &f, int qu, int qv) {
+		int config = 0;
+		for (int k = 0; k < 9; k++) {
+			const Vec3i p = face_point(f, qu*2 + k % 3, qv*2 + k / 3, half);
+			config |= (voxel(p) < 0.0f) << k;
+		}
+		return config;
+	};
+
+	// the coarse cells are the cells of the gathered samples
+	SignVolume &signs = ctx->signs;
+	signs.build<float>(samples.sub(), n);
+	MeshCount count = count_smooth_slab(signs, nullptr, 0, cells.z);
+	for (int face = 0; face < 6; face++) {
+		if (!(transition_faces & (1 << face)))
+			continue;
+		const TransitionFace f = transition_face(face, size, stride);
+		// a fine edge both faces have is made by the first one
+		auto counted = [&](const Vec3i &p, int axis) {
+			const int other = shared_face(face, p, axis, size);
+			return other != -1 && other < face && (transition_faces & (1 << other));
+		};
+		for (int v = 0; v <= f.v_quads*2; v++) {
+		for (int u = 0; u <= f.u_quads*2; u++) {
+			const Vec3i p = face_point(f, u, v, half);
+			const bool in = voxel(p) < 0.0f;
+			if (u < f.u_quads*2 && in != (voxel(face_point(f, u+1, v, half)) < 0.0f) &&
+					!counted(p, f.u_axis))
+				count.vertices++;
+			if (v < f.v_quads*2 && in != (voxel(face_point(f, u, v+1, half)) < 0.0f) &&
+					!counted(p, f.v_axis))
+				count.vertices++;
+		}}
+		for (int qv = 0; qv < f.v_quads; qv++) {
+		for (int qu = 0; qu < f.u_quads; qu++) {
+			count.indices += table.cells[transition_config(f, qu, qv)].n_triangles * 3;
+		}}
+	}
+	reserve_geometry(mesh, count);
+	const int first_index = mesh->indices.length();
+
+	// vertices are made by the first triangle using them
+	Vector<Vec3i> &edges = ctx->lod_edges;
+	edges.resize(volume(n));
+	fill(edges.sub(), Vec3i(-1));
+	auto coarse_vertex = [&](const Vec3i &p, int axis) {
+		const int64_t offset = offset_3d(p, n);
+		int &idx = edges[offset][axis];
+		if (idx == -1) {
+			idx = edge_vertex(p * Vec3i(stride), axis, stride, s[offset],
+				s[offset + axis_steps[axis]]);
+		}
+		return idx;
+	};
+
+	for (int z = 0; z < cells.z; z++) {
+	for (int y = 0; y < cells.y; y++) {
+	for_each_active_config(signs, y, z, [&](int x, int config_n) {
+		const Vec3i p(x, y, z);
+		const uint64_t config = marching_cube_tris[config_n];
+		const int n_triangles = config & 0xF;
+		const int index_base = mesh->indices.length();
+
+		int offset = 4;
+		for (int i = 0; i < n_triangles * 3; i++) {
+			const int edge = (config >> offset) & 0xF;
+			const int c = cell_edge_corners[edge];
+			const Vec3i corner = p + Vec3i(c & 1, (c >> 1) & 1, (c >> 2) & 1);
+			mesh->indices.append(coarse_vertex(corner, edge / 4));
+			offset += 4;
+		}
+		if (!face_normals)
+			return;
+		for (int i = 0; i < n_triangles; i++) {
+			triangle(mesh,
+				mesh->indices[index_base+i*3+0],
+				mesh->indices[index_base+i*3+1],
+				mesh->indices[index_base+i*3+2]);
+		}
+	});
+	}}
+	if (face_normals)
+		normalize_normals(mesh, first_vertex);
+
+	// fine edges on the edges of the grid, indexed by the edge of the grid
+	// (axis * 4 + the sides it's on along the other two axes) and the
+	// position along it, there are none at stride 1 (no transition faces)
+	Vector<int> &line_edges = ctx->transition_line_edges;
+	const int line_length = transition_faces ? (max3(size.x, size.y, size.z) - 1) / half : 0;
+	if (transition_faces) {
+		line_edges.resize(12 * line_length);
+		fill(line_edges.sub(), -1);
+	}
+	auto line_edge = [&](const Vec3i &p, int axis) -> int& {
+		const int b = (axis + 1) % 3;
+		const int c = (axis + 2) % 3;
+		const int line = axis * 4 + (p[b] != 0) * 2 + (p[c] != 0);
+		return line_edges[line * line_length + p[axis] / half];
+	};
+
+	Vector<Vec2i> &fine_edges = ctx->transition_edges;
+	for (int face = 0; face < 6; face++) {
+		if (!(transition_faces & (1 << face)))
+			continue;
+		const TransitionFace f = transition_face(face, size, stride);
+		const int fine_u = f.u_quads*2 + 1;
+		fine_edges.resize(fine_u * (f.v_quads*2 + 1));
+		fill(fine_edges.sub(), Vec2i(-1));
+
+		for (int qv = 0; qv < f.v_quads; qv++) {
+		for (int qu = 0; qu < f.u_quads; qu++) {
+			const TransitionCell &cell = table.cells[transition_config(f, qu, qv)];
+			int vertices[16];
+			for (int i = 0; i < 16; i++)
+				vertices[i] = -1;
+			auto vertex = [&](int e) {
+				if (vertices[e] != -1)
+					return vertices[e];
+				const int a = transition_edge_samples[e][0];
+				const int b = transition_edge_samples[e][1];
+				const bool along_u = b - a < 3;
+				if (e >= 12) {
+					// made by the coarse cells already
+					const Vec3i c = face_point(f, qu*2 + a % 3, qv*2 + a / 3, half) / Vec3i(stride);
+					return vertices[e] = coarse_vertex(c, along_u ? f.u_axis : f.v_axis);
+				}
+
+				const int u = qu*2 + a % 3;
+				const int v = qv*2 + a / 3;
+				const int axis = along_u ? f.u_axis : f.v_axis;
+				const Vec3i pa = face_point(f, u, v, half);
+				int &idx = shared_face(face, pa, axis, size) != -1 ? line_edge(pa, axis) :
+					along_u ? fine_edges[v * fine_u + u].x : fine_edges[v * fine_u + u].y;
+				if (idx == -1) {
+					Vec3i pb = pa;
+					pb[axis] += half;
+					idx = edge_vertex(pa, axis, half, voxel(pa), voxel(pb));
+				}
+				return vertices[e] = idx;
+			};
+			for (int i = 0; i < cell.n_triangles * 3; i++) {
+				const int idx = vertex(cell.edges[i]);
+				NG_ASSERT(idx != -1);
+				mesh->indices.append(idx);
+			}
+		}}
+	}
+	NG_ASSERT(mesh->vertices.length() == first_vertex + count.vertices);
+	NG_ASSERT(mesh->indices.length() == first_index + count.indices);
+}
+
+template <typename M, typename T>
+static void mesh_with_type(M *mesh, MeshType type, Slice<const T> voxels,
+	const Vec3i &size, const BrickPyramid *pyramid, MeshContext *ctx)
+{
+	switch (type) {
+	case MT_MARCHING_CUBES:
+		flat_marching_cubes(mesh, voxels, size, pyramid, ctx);
+		break;
+	case MT_MARCHING_CUBES_SMOOTH:
+		smooth_marching_cubes(mesh, voxels, size, pyramid, ctx);
+		break;
+	case MT_NAIVE_SURFACE_NETS:
+		naive_surface_nets(mesh, voxels, size, pyramid, Vec3i(0), ctx);
+		break;
+	}
+}
+
+static float packed_step(const Vec3i &size)
+{
+	// positions go from 0 to size-1
+	const int extent = std::max(max3(size.x, size.y, size.z) - 1, 1);
+	NG_ASSERT(extent <= 65535);
+	int scale = 1;
+	while (extent * scale * 2 <= 65535)
+		scale *= 2;
+	return 1.0f / scale;
+}
+
+void pack_mesh(PackedMesh *packed, const Mesh &mesh, const Vec3i &size)
+{
+	packed->step = packed_step(size);
+	packed->vertices.resize(mesh.vertices.length());
+	PackedVertex *out = packed->vertices.data();
+	for (const Vertex &v : mesh.vertices)
+		*out++ = make_vertex(packed, v.position, v.normal);
+	packed->indices.resize(mesh.indices.length());
+	copy(packed->indices.sub(), mesh.indices.sub());
+}
+
+// Gradient normals are final when a vertex is made, it goes straight into the
+// packed mesh. Face normals need the positions of all the faces around the
+// vertex, those are summed on the unpacked mesh of the context first.
+template <typename T>
+static void packed_mesh_with_type(PackedMesh *mesh, MeshType type, Slice<const T> voxels,
+	const Vec3i &size, const BrickPyramid *pyramid, MeshContext *ctx)
+{
+	if (ctx->normals == NM_GRADIENT) {
+		mesh->clear();
+		mesh->step = packed_step(size);
+		mesh_with_type(mesh, type, voxels, size, pyramid, ctx);
+		return;
+	}
+	ctx->unpacked.clear();
+	mesh_with_type(&ctx->unpacked, type, voxels, size, pyramid, ctx);
+	pack_mesh(mesh, ctx->unpacked, size);
+}
+
+// the entry points use a context of their own if not given one
+#define NG_MESHERS(T)                                                                          \
+void generate_geometry(Mesh *mesh, Slice<const T> voxels, const Vec3i &size,                  \
+	const BrickPyramid *pyramid, MeshContext *context)                                     \
+{                                                                                              \
+	MeshContext local;                                                                     \
+	flat_marching_cubes(mesh, voxels, size, pyramid, context ? context : &local);          \
+}                                                                                              \
+void generate_geometry_smooth(Mesh *mesh, Slice<const T> voxels, const Vec3i &size,           \
+	const BrickPyramid *pyramid, MeshContext *context)                                     \
+{                                                                                              \
+	MeshContext local;                                                                     \
+	smooth_marching_cubes(mesh, voxels, size, pyramid, context ? context : &local);        \
+}                                                                                              \
+void generate_geometry_smooth_parallel(Mesh *mesh, Slice<const T> voxels,                     \
+	const Vec3i &size, int num_threads, const BrickPyramid *pyramid, MeshContext *context) \
+{                                                                                              \
+	MeshContext local;                                                                     \
+	smooth_marching_cubes_parallel(mesh, voxels, size, num_threads, pyramid,               \
+		context ? context : &local);                                                   \
+}                                                                                              \
+void generate_geometry_naive_surface_nets(Mesh *mesh, Slice<const T> voxels,                  \
+	const Vec3i &size, const BrickPyramid *pyramid, MeshContext *context)                  \
+{                                                                                              \
+	MeshContext local;                                                                     \
+	naive_surface_nets(mesh, voxels, size, pyramid, Vec3i(0), context ? context : &local); \
+}                                                                                              \
+void generate_geometry_lod(Mesh *mesh, Slice<const T> voxels, const Vec3i &size,              \
+	int stride, int transition_faces, MeshContext *context)                                \
+{                                                                                              \
+	MeshContext local;                                                                     \
+	lod_marching_cubes(mesh, voxels, size, stride, transition_faces,                       \
+		context ? context : &local);                                                   \
+}                                                                                              \
+void generate_mesh(Mesh *mesh, MeshType type, Slice<const T> voxels,                          \
+	const Vec3i &size, const BrickPyramid *pyramid, MeshContext *context)                  \
+{                                                                                              \
+	MeshContext local;                                                                     \
+	mesh_with_type(mesh, type, voxels, size, pyramid, context ? context : &local);         \
+}                                                                                              \
+void generate_mesh(PackedMesh *mesh, MeshType type, Slice<const T> voxels,                    \
+	const Vec3i &size, const BrickPyramid *pyramid, MeshContext *context)                  \
+{                                                                                              \
+	MeshContext local;                                                                     \
+	packed_mesh_with_type(mesh, type, voxels, size, pyramid, context ? context : &local);  \
+}
+
+NG_MESHERS(float)
+NG_MESHERS(int8_t)
+NG_MESHERS(uint16_t)
+NG_MESHERS(Half)
+
+// A vertex of the current region as far as its seams are concerned. 'key' is
+// the same in every region which makes the vertex: surface nets vertices are
+// keyed by their cell, smooth marching cubes ones by the bits of their
+// position, which regions sharing an edge compute the same way as they have
+// the same origin along it.
+struct SeamVertex {
+	Vec3i key;
+	// on a low face of the region, an earlier region may have made it
+	bool copy;
+	// on a high face of the region, later regions may need it
+	bool shared;
+	int index;
+};
+
+// Drops the vertices of the last region which earlier regions already made
+// and points the region's indices at theirs.
+static void weld_region(Mesh *mesh, int first_vertex, int first_index,
+	Slice<SeamVertex> seam, std::unordered_map<Vec3i, int, Vec3iHash> *seam_vertices)
+{
+	NG_ASSERT(seam.length == mesh->vertices.length() - first_vertex);
+	int n_vertices = first_vertex;
+	for (int i = 0; i < seam.length; i++) {
+		SeamVertex &s = seam[i];
+		s.index = -1;
+		if (s.copy) {
+			auto it = seam_vertices->find(s.key);
+			if (it != seam_vertices->end())
+				s.index = it->second;
+		}
+		if (s.index < 0) {
+			s.index = n_vertices;
+			mesh->vertices[n_vertices++] = mesh->vertices[first_vertex + i];
+		}
+		if (s.shared)
+			seam_vertices->emplace(s.key, s.index);
+	}
+	mesh->vertices.resize(n_vertices);
+	for (int &idx : mesh->indices.sub(first_index))
+		idx = seam[idx - first_vertex].index;
+}
+
+void generate_geometry_sparse(Mesh *mesh, MeshType type, const SparseVolume &volume,
+	int region_size)
+{
+	NG_ASSERT(region_size > 0);
+	const Vec3i n_cells = volume.size - Vec3i(1);
+	const Vec3i n_regions = (n_cells + Vec3i(region_size-1)) / Vec3i(region_size);
+	const int first_vertex = mesh->vertices.length();
+	const int first_index = mesh->indices.length();
+
+	// surface nets connect a cell to the cells behind it, so regions start
+	// one cell early to have the vertices for the quads on the seams,
+	// marching cubes cells are independent
+	const int overlap = type == MT_NAIVE_SURFACE_NETS ? 1 : 0;
+
+	// flat marching cubes cells have vertices of their own, the other types
+	// share them with the neighbouring cells, across seams too
+	const bool weld = type != MT_MARCHING_CUBES;
+	std::unordered_map<Vec3i, int, Vec3iHash> seam_vertices;
+	Vector<SeamVertex> seam;
+
+	Vector<float> voxels;
+	MeshContext ctx;
+	for (int rz = 0; rz < n_regions.z; rz++) {
+	for (int ry = 0; ry < n_regions.y; ry++) {
+	for (int rx = 0; rx < n_regions.x; rx++) {
+		const Vec3i r(rx, ry, rz);
+		const Vec3i cmin = max(r * Vec3i(region_size) - Vec3i(overlap), Vec3i(0));
+		const Vec3i cmax = min((r + Vec3i(1)) * Vec3i(region_size), n_cells);
+		if (!volume.bounds(cmin, cmax).crosses())
+			continue;
+
+		const Vec3i dims = cmax - cmin + Vec3i(1);
+		voxels.resize(::volume(dims));
+		volume.gather(voxels.data(), cmin, dims);
+
+		const int region_vertex = mesh->vertices.length();
+		const int region_index = mesh->indices.length();
+		const Vec3i quad_min = r * Vec3i(region_size) - cmin;
+		if (overlap)
+			naive_surface_nets<Mesh, float>(mesh, voxels, dims, nullptr, quad_min, &ctx);
+		else
+			mesh_with_type<Mesh, float>(mesh, type, voxels, dims, nullptr, &ctx);
+		const Vec3f offset = ToVec3f(cmin);
+		for (Vertex &v : mesh->vertices.sub(region_vertex))
+			v.position += offset;
+		if (!weld)
+			continue;
+
+		// surface nets make a vertex per cell, in the order they're counted,
+		// the ones in the overlap are all copies
+		seam.clear();
+		if (overlap) {
+			count_cells(ctx.signs, nullptr, 0, dims.z-1,
+				[&](MeshCount*, const Vec3i &p, int) {
+					const Vec3i c = cmin + p;
+					bool shared = false;
+					for (int i = 0; i < 3; i++)
+						shared |= c[i] == cmax[i]-1 && cmax[i] < n_cells[i];
+					seam.append({c, !(p >= quad_min), shared, -1});
+				});
+		} else {
+			for (const Vertex &v : mesh->vertices.sub(region_vertex)) {
+				SeamVertex s = {Vec3i(0), false, false, -1};
+				memcpy(s.key.data, &v.position, sizeof(s.key));
+				for (int i = 0; i < 3; i++) {
+					s.copy |= cmin[i] > 0 && v.position[i] == cmin[i];
+					s.shared |= cmax[i] < n_cells[i] && v.position[i] == cmax[i];
+				}
+				seam.append(s);
+			}
+		}
+		weld_region(mesh, region_vertex, region_index, seam, &seam_vertices);
+	}}}
+	if (!weld)
+		return;
+
+	// a seam vertex has faces in several regions, its face normal is only
+	// complete once they're all welded
+	for (Vertex &v : mesh->vertices.sub(first_vertex))
+		v.normal = Vec3f(0);
+	for (int i = first_index; i < mesh->indices.length(); i += 3)
+		triangle(mesh, mesh->indices[i], mesh->indices[i+1], mesh->indices[i+2]);
+	normalize_normals(mesh, first_vertex);
+}
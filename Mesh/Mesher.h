@@ -0,0 +1,235 @@
+#pragma once
+
+#include "Core/Vector.h"
+#include "Math/Vec.h"
+#include "Math/Pack.h"
+#include "Mesh/Sample.h"
+
+struct BrickPyramid;
+struct SparseVolume;
+struct MeshContext;
+
+struct Vertex {
+	Vec3f position;
+	Vec3f normal;
+};
+
+enum MeshType {
+	MT_MARCHING_CUBES,
+	MT_MARCHING_CUBES_SMOOTH,
+	MT_NAIVE_SURFACE_NETS,
+};
+
+enum NormalMode {
+	// face normals summed on the vertices they touch, then normalized
+	NM_FACES,
+	// gradient of the field at the vertex, computed when the vertex is
+	// created, interpolated along the crossing edge (summed over the crossing
+	// edges of the cell for surface nets)
+	NM_GRADIENT,
+};
+
+struct Mesh {
+	Vector<Vertex> vertices;
+	Vector<int> indices;
+
+	void clear()
+	{
+		vertices.clear();
+		indices.clear();
+	}
+};
+
+// 10 bytes instead of 24: the position is in steps of PackedMesh::step from
+// the grid origin, the normal is octahedral encoded (see Math/Pack.h).
+struct PackedVertex {
+	Vec3us position;
+	Vec2s normal;
+};
+
+struct PackedMesh {
+	Vector<PackedVertex> vertices;
+	Vector<int> indices;
+
+	// a power of two, the finest one which fits the whole grid in 16 bits
+	float step = 1.0f;
+
+	Vec3f position(const PackedVertex &v) const
+	{
+		return Vec3f(v.position.x, v.position.y, v.position.z) * Vec3f(step);
+	}
+	Vec3f normal(const PackedVertex &v) const { return decode_octahedral(v.normal); }
+
+	void clear()
+	{
+		vertices.clear();
+		indices.clear();
+	}
+};
+
+// 64 bit, a volume can hold more than 2^31 samples
+static inline int64_t offset_3d(const Vec3i &p, const Vec3i &size)
+{
+	return (int64_t(p.z) * size.y + p.y) * size.x + p.x;
+}
+
+static inline int offset_3d_slab(const Vec3i &p, const Vec3i &size)
+{
+	return size.x * size.y * (p.z % 2) + p.y * size.x + p.x;
+}
+
+// for hash maps keyed by grid positions
+struct Vec3iHash {
+	size_t operator()(const Vec3i &v) const
+	{
+		return compute_hash(Slice<const int>(v.data, 3));
+	}
+};
+
+// All the meshers below take a dense grid of 'size.x * size.y * size.z'
+// samples laid out according to offset_3d, negative values are inside. The
+// grid has (size - 1) cells in each dimension. Generated geometry is appended
+// to the mesh, positions are in voxel units relative to the grid origin. The
+// output is counted before meshing, the mesh grows at most once per call.
+//
+// Every mesher comes in a version for each sample format (see Sample.h).
+//
+// An optional up-to-date min/max pyramid of the grid lets the meshers skip
+// bricks without a surface crossing without reading their voxels. An optional
+// context (see MeshContext.h) provides the scratch memory, reusing one saves
+// allocations when meshing many grids.
+void generate_geometry(Mesh *mesh, Slice<const float> voxels, const Vec3i &size,
+	const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+void generate_geometry(Mesh *mesh, Slice<const int8_t> voxels, const Vec3i &size,
+	const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+void generate_geometry(Mesh *mesh, Slice<const uint16_t> voxels, const Vec3i &size,
+	const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+void generate_geometry(Mesh *mesh, Slice<const Half> voxels, const Vec3i &size,
+	const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+
+void generate_geometry_smooth(Mesh *mesh, Slice<const float> voxels, const Vec3i &size,
+	const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+void generate_geometry_smooth(Mesh *mesh, Slice<const int8_t> voxels, const Vec3i &size,
+	const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+void generate_geometry_smooth(Mesh *mesh, Slice<const uint16_t> voxels, const Vec3i &size,
+	const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+void generate_geometry_smooth(Mesh *mesh, Slice<const Half> voxels, const Vec3i &size,
+	const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+
+// Same output as generate_geometry_smooth, byte for byte, but the volume is
+// split into z slabs which are meshed by 'num_threads' tasks on the default
+// scheduler (0 means one per hardware thread). Slabs are counted first and
+// write straight into their part of the mesh.
+void generate_geometry_smooth_parallel(Mesh *mesh, Slice<const float> voxels,
+	const Vec3i &size, int num_threads = 0, const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+void generate_geometry_smooth_parallel(Mesh *mesh, Slice<const int8_t> voxels,
+	const Vec3i &size, int num_threads = 0, const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+void generate_geometry_smooth_parallel(Mesh *mesh, Slice<const uint16_t> voxels,
+	const Vec3i &size, int num_threads = 0, const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+void generate_geometry_smooth_parallel(Mesh *mesh, Slice<const Half> voxels,
+	const Vec3i &size, int num_threads = 0, const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+
+void generate_geometry_naive_surface_nets(Mesh *mesh, Slice<const float> voxels,
+	const Vec3i &size, const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+void generate_geometry_naive_surface_nets(Mesh *mesh, Slice<const int8_t> voxels,
+	const Vec3i &size, const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+void generate_geometry_naive_surface_nets(Mesh *mesh, Slice<const uint16_t> voxels,
+	const Vec3i &size, const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+void generate_geometry_naive_surface_nets(Mesh *mesh, Slice<const Half> voxels,
+	const Vec3i &size, const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+
+// Runs the mesher of the given type.
+void generate_mesh(Mesh *mesh, MeshType type, Slice<const float> voxels,
+	const Vec3i &size, const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+void generate_mesh(Mesh *mesh, MeshType type, Slice<const int8_t> voxels,
+	const Vec3i &size, const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+void generate_mesh(Mesh *mesh, MeshType type, Slice<const uint16_t> voxels,
+	const Vec3i &size, const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+void generate_mesh(Mesh *mesh, MeshType type, Slice<const Half> voxels,
+	const Vec3i &size, const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+
+// Faces of a grid, for the transition cells of generate_geometry_lod.
+enum GridFace {
+	GF_NEG_X = 1 << 0,
+	GF_POS_X = 1 << 1,
+	GF_NEG_Y = 1 << 2,
+	GF_POS_Y = 1 << 3,
+	GF_NEG_Z = 1 << 4,
+	GF_POS_Z = 1 << 5,
+};
+
+// Smooth marching cubes on every 'stride'-th sample of the grid, (size - 1)
+// has to be a multiple of the stride. Positions are still in voxel units.
+//
+// The faces in 'transition_faces' border a grid meshed at half the stride
+// (the stride has to be 2 at least for that), which meets the face with a
+// finer surface than the coarse cells do. Every face quad there gets a
+// transition cell, made from the 3x3 fine samples of the quad, which joins
+// the coarse surface to the fine one. Meshes of neighbouring grids have no
+// cracks between them as long as their strides differ by a factor of two at
+// most across faces. Transition cells have no depth: their triangles lie on
+// the face, filling the sliver between the two surfaces, and they add
+// nothing to the face normals of the coarse vertices.
+//
+// Meant for chunk sized grids, it doesn't skip empty bricks and keeps the
+// vertex indices of the whole coarse grid in the context.
+void generate_geometry_lod(Mesh *mesh, Slice<const float> voxels, const Vec3i &size,
+	int stride, int transition_faces, MeshContext *context = nullptr);
+void generate_geometry_lod(Mesh *mesh, Slice<const int8_t> voxels, const Vec3i &size,
+	int stride, int transition_faces, MeshContext *context = nullptr);
+void generate_geometry_lod(Mesh *mesh, Slice<const uint16_t> voxels, const Vec3i &size,
+	int stride, int transition_faces, MeshContext *context = nullptr);
+void generate_geometry_lod(Mesh *mesh, Slice<const Half> voxels, const Vec3i &size,
+	int stride, int transition_faces, MeshContext *context = nullptr);
+
+// Packs the mesh of a grid of the given size, replacing the contents of
+// 'packed'. Positions are rounded to the nearest step, normals are expected
+// to be normalized.
+void pack_mesh(PackedMesh *packed, const Mesh &mesh, const Vec3i &size);
+
+// Runs the mesher of the given type and packs the result, replacing the
+// contents of 'mesh'. With gradient normals the mesher writes packed vertices
+// directly. Face normals are summed on an unpacked mesh first, which only
+// lives in the context's scratch memory and is reused by the next call.
+void generate_mesh(PackedMesh *mesh, MeshType type, Slice<const float> voxels,
+	const Vec3i &size, const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+void generate_mesh(PackedMesh *mesh, MeshType type, Slice<const int8_t> voxels,
+	const Vec3i &size, const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+void generate_mesh(PackedMesh *mesh, MeshType type, Slice<const uint16_t> voxels,
+	const Vec3i &size, const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+void generate_mesh(PackedMesh *mesh, MeshType type, Slice<const Half> voxels,
+	const Vec3i &size, const BrickPyramid *pyramid = nullptr,
+	MeshContext *context = nullptr);
+
+// Meshes a sparse volume region by region, each region is 'region_size'
+// cells large. Regions which can't have a crossing according to the brick
+// bounds are skipped, the rest are gathered into a dense grid and meshed with
+// the mesher of the given type. Vertices on the seams are welded, so the mesh
+// has the vertices of the dense one (the order differs) and its face normals
+// are summed across seams. Vertices of different edges which coincide, where
+// a sample is exactly zero, may be welded as well.
+void generate_geometry_sparse(Mesh *mesh, MeshType type, const SparseVolume &volume,
+	int region_size = 64);
@@ -0,0 +1,104 @@
+#include "Mesh/Sample.h"
+#include "Core/Utils.h"
+#include "Math/Utils.h"
+#include <cmath>
+#include <cstring>
+
+float half_to_float(uint16_t h)
+{
+	const uint32_t sign = uint32_t(h & 0x8000) << 16;
+	const uint32_t exponent = (h >> 10) & 0x1F;
+	const uint32_t mantissa = h & 0x3FF;
+
+	uint32_t bits;
+	if (exponent == 0) {
+		// zero or subnormal, mantissa * 2^-24
+		const float f = (float)mantissa * 5.9604645e-8f;
+		return sign ? -f : f;
+	} else if (exponent == 31) {
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	} else {
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	}
+
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+// round to nearest, ties to even
+uint16_t float_to_half(float f)
+{
+	uint32_t x;
+	memcpy(&x, &f, sizeof(x));
+	const uint16_t sign = (x >> 16) & 0x8000;
+	x &= 0x7FFFFFFF;
+
+	// inf and nan
+	if (x >= 0x7F800000)
+		return sign | 0x7C00 | (x > 0x7F800000 ? 0x200 : 0);
+	// 65520 and up round to inf
+	if (x >= 0x477FF000)
+		return sign | 0x7C00;
+
+	// below 2^-14 the result is subnormal, below 2^-25 it rounds to zero
+	if (x < 0x38800000) {
+		if (x < 0x33000000)
+			return sign;
+		const int shift = 126 - int(x >> 23);
+		const uint32_t m = (x & 0x7FFFFF) | 0x800000;
+		const uint32_t h = m >> shift;
+		const uint32_t rem = m & ((1u << shift) - 1);
+		const uint32_t half = 1u << (shift - 1);
+		return sign | (h + (rem > half || (rem == half && (h & 1))));
+	}
+
+	// rebias the exponent, a carry out of the mantissa bumps it as it should
+	uint32_t h = (x >> 13) - (112 << 10);
+	const uint32_t rem = x & 0x1FFF;
+	h += rem > 0x1000 || (rem == 0x1000 && (h & 1));
+	return sign | h;
+}
+
+template <typename T, typename F>
+static void quantize(Slice<T> dst, Slice<const float> src, float scale, F &&f)
+{
+	NG_ASSERT(dst.length == src.length);
+	NG_ASSERT(scale > 0.0f);
+	const float inv_scale = 1.0f / scale;
+	for (int64_t i = 0; i < src.length; i++)
+		dst[i] = f(src[i] * inv_scale, src[i] < 0.0f);
+}
+
+void quantize_samples(Slice<float> dst, Slice<const float> src, float scale)
+{
+	quantize(dst, src, scale, [](float v, bool) { return v; });
+}
+
+void quantize_samples(Slice<int8_t> dst, Slice<const float> src, float scale)
+{
+	// floor keeps the sign, a negative value lands in a negative step
+	quantize(dst, src, scale, [](float v, bool) {
+		const int q = std::floor(clamp(v, -1.0f, 1.0f) * 128.0f);
+		return int8_t(std::min(q, 127));
+	});
+}
+
+void quantize_samples(Slice<uint16_t> dst, Slice<const float> src, float scale)
+{
+	quantize(dst, src, scale, [](float v, bool) {
+		const int q = std::floor(clamp(v, -1.0f, 1.0f) * 32768.0f);
+		return uint16_t(32768 + std::min(q, 32767));
+	});
+}
+
+void quantize_samples(Slice<Half> dst, Slice<const float> src, float scale)
+{
+	quantize(dst, src, scale, [](float v, bool inside) {
+		Half h = {float_to_half(v)};
+		// tiny negative values flush to -0, which isn't inside
+		if (inside && !sample_inside(h))
+			h.bits = 0x8001;
+		return h;
+	});
+}
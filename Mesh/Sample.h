@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include "Core/Slice.h"
+
+// Voxel sample formats. Besides float the meshers take:
+//   - int8_t, the field divided by a per-volume scale and quantized to 256
+//     steps over [-1, 1]
+//   - uint16_t, the same with 65536 steps, biased by 32768
+//   - Half, an IEEE 754 half precision float
+// The integer formats decode to the middle of their step, so no sample is
+// ever zero and the ones next to the surface are as far from it on both
+// sides. Samples are decoded to float before interpolating. Interpolation
+// only looks at the ratio of two samples, so the scale doesn't change the
+// surface and the meshers never need to know it.
+
+// storage only, decode it to do math
+struct Half {
+	uint16_t bits;
+};
+
+float half_to_float(uint16_t h);
+uint16_t float_to_half(float f);
+
+static inline float decode_sample(float v) { return v; }
+static inline float decode_sample(int8_t v) { return (float)v + 0.5f; }
+static inline float decode_sample(uint16_t v) { return (float)v - 32767.5f; }
+static inline float decode_sample(Half v) { return half_to_float(v.bits); }
+
+// same as decode_sample(v) < 0, without decoding
+static inline bool sample_inside(float v) { return v < 0.0f; }
+static inline bool sample_inside(int8_t v) { return v < 0; }
+static inline bool sample_inside(uint16_t v) { return v < 32768; }
+static inline bool sample_inside(Half v) { return (v.bits & 0x8000) && (v.bits & 0x7FFF); }
+
+// Converts 'src' to the sample format of 'dst', values are divided by 'scale'
+// first. For the integer formats 'scale' is the magnitude which maps to the
+// end of the range, the rest is clamped. Rounding never moves a sample to the
+// other side of the surface, so the quantized volume has the same topology.
+// For a distance-like field a scale of a few voxels worth of distance works
+// best, further samples don't affect the surface.
+void quantize_samples(Slice<float> dst, Slice<const float> src, float scale);
+void quantize_samples(Slice<int8_t> dst, Slice<const float> src, float scale);
+void quantize_samples(Slice<uint16_t> dst, Slice<const float> src, float scale);
+void quantize_samples(Slice<Half> dst, Slice<const float> src, float scale);
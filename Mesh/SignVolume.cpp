@@ -0,0 +1,109 @@
+#include "Mesh/SignVolume.h"
+
+void SignVolume::resize(const Vec3i &size)
+{
+	this->size = size;
+	row_words = (size.x + 63) / 64;
+	bits.resize(int64_t(row_words) * size.y * size.z);
+}
+
+static_assert(64 % BrickPyramid::BRICK_SIZE == 0, "bricks must tile sign words");
+
+// For every sign word of the voxel rows of a brick row: which of its bricks
+// have a crossing and which of them are entirely inside, one bit per brick.
+struct BrickRowMasks {
+	Vector<uint8_t> crossing;
+	Vector<uint8_t> inside;
+
+	void compute(const BrickPyramid &pyramid, int by, int bz, int row_words)
+	{
+		constexpr int BS = BrickPyramid::BRICK_SIZE;
+		const BrickPyramidLevel &level = pyramid.levels[0];
+		const MinMax *bricks = &level.at({0, by, bz});
+		crossing.resize(row_words);
+		inside.resize(row_words);
+		for (int w = 0; w < row_words; w++) {
+			uint8_t c = 0, in = 0;
+			for (int i = 0; i < 64 / BS; i++) {
+				const int x = w * 64 + i * BS;
+				if (x >= pyramid.size.x)
+					break;
+
+				// the last voxel of the row may start a brick past the end
+				const MinMax &mm = bricks[std::min(x / BS, level.size.x-1)];
+				c |= mm.crosses() << i;
+				in |= (mm.max < 0.0f) << i;
+			}
+			crossing[w] = c;
+			inside[w] = in;
+		}
+	}
+};
+
+static uint64_t spread_brick_bits(uint8_t bits)
+{
+	constexpr int BS = BrickPyramid::BRICK_SIZE;
+	uint64_t word = 0;
+	for (int i = 0; bits; i++, bits >>= 1) {
+		if (bits & 1)
+			word |= ((uint64_t(1) << BS) - 1) << (i * BS);
+	}
+	return word;
+}
+
+template <typename T>
+void SignVolume::build(Slice<const T> voxels, int z0, int z1,
+	const BrickPyramid *pyramid)
+{
+	NG_ASSERT(voxels.length == volume(size));
+	NG_ASSERT(pyramid == nullptr || pyramid->size == size);
+
+	BrickRowMasks masks;
+	Vec3i masks_brick(-1);
+	for (int z = z0; z < z1; z++) {
+	for (int y = 0; y < size.y; y++) {
+		const T *src = voxels.data + offset_3d({0, y, z}, size);
+		uint64_t *dst = bits.data() + (int64_t(z) * size.y + y) * row_words;
+		if (!pyramid) {
+			pack_signs(dst, src, size.x);
+			continue;
+		}
+
+		const Vec3i b = pyramid->brick_of({0, y, z});
+		if (b != masks_brick) {
+			masks.compute(*pyramid, b.y, b.z, row_words);
+			masks_brick = b;
+		}
+		for (int w = 0; w < row_words; w++) {
+			const int n = std::min(64, size.x - w * 64);
+			if (masks.crossing[w]) {
+				pack_signs(dst + w, src + w * 64, n);
+				continue;
+			}
+
+			// bits past the end of the row are never looked at, but keep
+			// them clean
+			uint64_t word = spread_brick_bits(masks.inside[w]);
+			if (n < 64)
+				word &= (uint64_t(1) << n) - 1;
+			dst[w] = word;
+		}
+	}}
+}
+
+template <typename T>
+void SignVolume::build(Slice<const T> voxels, const Vec3i &size,
+	const BrickPyramid *pyramid)
+{
+	resize(size);
+	build(voxels, 0, size.z, pyramid);
+}
+
+#define NG_INSTANTIATE_BUILD(T)                                                         \
+template void SignVolume::build(Slice<const T>, int, int, const BrickPyramid*);         \
+template void SignVolume::build(Slice<const T>, const Vec3i&, const BrickPyramid*);
+
+NG_INSTANTIATE_BUILD(float)
+NG_INSTANTIATE_BUILD(int8_t)
+NG_INSTANTIATE_BUILD(uint16_t)
+NG_INSTANTIATE_BUILD(Half)
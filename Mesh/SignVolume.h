@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include "Core/Vector.h"
+#include "Math/Vec.h"
+#include "Mesh/BrickPyramid.h"
+#include "Mesh/Classify.h"
+#include "Mesh/Mesher.h"
+
+// One bit per voxel, set if the voxel is inside (< 0). Every x row is padded
+// to a whole number of 64-bit words, so a row can be classified 64 cells at a
+// time.
+struct SignVolume {
+	Vector<uint64_t> bits;
+	Vec3i size = Vec3i(0);
+	int row_words = 0;
+
+	void resize(const Vec3i &size);
+
+	// Packs z slices [z0, z1), the volume has to be resized first. If the
+	// pyramid is given, voxels of bricks without a surface crossing aren't
+	// read, their sign is known from the brick's min/max. Instantiated for
+	// all the sample formats.
+	template <typename T>
+	void build(Slice<const T> voxels, int z0, int z1,
+		const BrickPyramid *pyramid = nullptr);
+	template <typename T>
+	void build(Slice<const T> voxels, const Vec3i &size,
+		const BrickPyramid *pyramid = nullptr);
+
+	const uint64_t *row(int y, int z) const
+	{
+		return bits.data() + (int64_t(z) * size.y + y) * row_words;
+	}
+};
+
+// Returns the mask of cells in the word 'w' of the row of cells (y, z) which
+// have a surface crossing, i.e. not all of their 8 corners are on the same
+// side.
+static inline uint64_t active_cells(const SignVolume &sv, int y, int z, int w)
+{
+	const uint64_t *r00 = sv.row(y,   z);
+	const uint64_t *r10 = sv.row(y+1, z);
+	const uint64_t *r01 = sv.row(y,   z+1);
+	const uint64_t *r11 = sv.row(y+1, z+1);
+
+	const uint64_t any = r00[w] | r10[w] | r01[w] | r11[w];
+	const uint64_t all = r00[w] & r10[w] & r01[w] & r11[w];
+	uint64_t any_next = any >> 1;
+	uint64_t all_next = all >> 1;
+	if (w+1 < sv.row_words) {
+		const int n = w+1;
+		any_next |= (r00[n] | r10[n] | r01[n] | r11[n]) << 63;
+		all_next |= (r00[n] & r10[n] & r01[n] & r11[n]) << 63;
+	}
+
+	uint64_t mask = (any | any_next) & ~(all & all_next);
+
+	// the last voxel of a row doesn't start a cell
+	const int n_cells = sv.size.x - 1 - w * 64;
+	if (n_cells < 64)
+		mask &= (uint64_t(1) << n_cells) - 1;
+	return mask;
+}
+
+// Two bits of the row starting at bit x, the second one may be in the next word.
+static inline int cell_bits(const uint64_t *row, int x)
+{
+	const int w = x / 64;
+	const int b = x % 64;
+	uint64_t bits = row[w] >> b;
+	if (b == 63)
+		bits |= row[w+1] << 1;
+	return bits & 3;
+}
+
+// Calls f(x, config) for every cell of the row (y, z) which has a surface
+// crossing, in increasing x order, 'config' is read straight from the sign
+// bits.
+template <typename F>
+void for_each_active_config(const SignVolume &sv, int y, int z, F &&f)
+{
+	const uint64_t *r00 = sv.row(y,   z);
+	const uint64_t *r10 = sv.row(y+1, z);
+	const uint64_t *r01 = sv.row(y,   z+1);
+	const uint64_t *r11 = sv.row(y+1, z+1);
+	for (int w = 0; w < sv.row_words; w++) {
+		uint64_t mask = active_cells(sv, y, z, w);
+		while (mask) {
+			const int x = w * 64 + __builtin_ctzll(mask);
+			mask &= mask - 1;
+			f(x, cell_bits(r00, x) | cell_bits(r10, x) << 2 |
+				cell_bits(r01, x) << 4 | cell_bits(r11, x) << 6);
+		}
+	}
+}
+
+// Same as for_each_active_config, but 'config' may be computed from the
+// voxels. The sign volume tells which 64 cell spans are worth looking at, for
+// floats 'config' is computed from 'voxels' by the SIMD kernel, the quantized
+// formats read it from the sign bits.
+template <typename T, typename F>
+void for_each_active_cell(const SignVolume &sv, Slice<const T>, int y, int z, F &&f)
+{
+	for_each_active_config(sv, y, z, f);
+}
+
+template <typename F>
+void for_each_active_cell(const SignVolume &sv, Slice<const float> voxels, int y, int z, F &&f)
+{
+	const Vec3i &size = sv.size;
+	const float *r00 = voxels.data + offset_3d({0, y,   z},   size);
+	const float *r10 = voxels.data + offset_3d({0, y+1, z},   size);
+	const float *r01 = voxels.data + offset_3d({0, y,   z+1}, size);
+	const float *r11 = voxels.data + offset_3d({0, y+1, z+1}, size);
+
+	ActiveCell cells[64];
+	for (int w = 0; w < sv.row_words; w++) {
+		if (!active_cells(sv, y, z, w))
+			continue;
+
+		const int x0 = w * 64;
+		const int x1 = std::min(x0 + 64, size.x - 1);
+		const int n = classify_cells(cells, r00, r10, r01, r11, x0, x1);
+		for (int i = 0; i < n; i++)
+			f(cells[i].x, cells[i].config);
+	}
+}
@@ -0,0 +1,356 @@
+#include "Mesh/Simplify.h"
+
+// Sum of squared distances to a set of planes, as a symmetric 4x4 matrix of
+// which only the upper triangle is stored.
+struct Quadric {
+	double m[10] = {};
+
+	void add_plane(const Vec3f &n, float d, float weight)
+	{
+		const double a = n.x, b = n.y, c = n.z, e = d;
+		const double v[10] = {
+			a*a, a*b, a*c, a*e,
+			     b*b, b*c, b*e,
+			          c*c, c*e,
+			               e*e,
+		};
+		for (int i = 0; i < 10; i++)
+			m[i] += v[i] * weight;
+	}
+
+	void add(const Quadric &q)
+	{
+		for (int i = 0; i < 10; i++)
+			m[i] += q.m[i];
+	}
+
+	double error(const Vec3f &p) const
+	{
+		const double x = p.x, y = p.y, z = p.z;
+		return m[0]*x*x + 2*m[1]*x*y + 2*m[2]*x*z + 2*m[3]*x +
+			m[4]*y*y + 2*m[5]*y*z + 2*m[6]*y +
+			m[7]*z*z + 2*m[8]*z +
+			m[9];
+	}
+};
+
+struct Collapse {
+	double error;
+	int from;
+	int to;
+};
+
+// Triangles around every vertex, in the CSR layout.
+struct VertexTriangles {
+	ScratchVector<int> offsets;
+	ScratchVector<int> triangles;
+
+	void build(Slice<const int> indices, int num_vertices)
+	{
+		offsets.resize(num_vertices + 1);
+		fill(offsets.sub(), 0);
+		for (int idx : indices)
+			offsets[idx+1]++;
+		for (int v = 0; v < num_vertices; v++)
+			offsets[v+1] += offsets[v];
+		triangles.resize(indices.length);
+		for (int i = 0; i < indices.length; i++)
+			triangles[offsets[indices[i]]++] = i / 3;
+		// the fill moved every offset to the end of its list
+		for (int v = num_vertices; v > 0; v--)
+			offsets[v] = offsets[v-1];
+		offsets[0] = 0;
+	}
+
+	Slice<const int> of(int v) const
+	{
+		return triangles.sub(offsets[v], offsets[v+1]);
+	}
+};
+
+// Flat shaded vertices are unique to a cell, but the ones on the same edge
+// have exactly the same position. Returns the number of welded vertices.
+static int weld_positions(ScratchVector<Vec3f> *positions, ScratchVector<int> *remap,
+	Slice<const Vertex> vertices)
+{
+	ScratchVector<int> order(vertices.length);
+	for (int i = 0; i < vertices.length; i++)
+		order[i] = i;
+	sort(order.sub(), [&](int a, int b) {
+		const Vec3f &pa = vertices[a].position;
+		const Vec3f &pb = vertices[b].position;
+		if (pa.x != pb.x)
+			return pa.x < pb.x;
+		if (pa.y != pb.y)
+			return pa.y < pb.y;
+		return pa.z < pb.z;
+	});
+
+	remap->resize(vertices.length);
+	positions->clear();
+	for (int i = 0; i < order.length(); i++) {
+		const Vec3f &p = vertices[order[i]].position;
+		if (i == 0 || p != positions->last())
+			positions->append(p);
+		(*remap)[order[i]] = positions->length() - 1;
+	}
+	return positions->length();
+}
+
+static Vec3f triangle_normal(const Vec3f &a, const Vec3f &b, const Vec3f &c)
+{
+	return cross(b - a, c - a);
+}
+
+// Vertices on edges used by a single triangle, or by more than two.
+static void find_boundary(ScratchVector<uint8_t> *locked, Slice<const int> indices,
+	const VertexTriangles &vt)
+{
+	for (int t = 0; t < indices.length / 3; t++) {
+	for (int k = 0; k < 3; k++) {
+		const int a = indices[t*3+k];
+		const int b = indices[t*3+(k+1)%3];
+		int opposite = 0;
+		for (int u : vt.of(b)) {
+			for (int j = 0; j < 3; j++) {
+				if (indices[u*3+j] == b && indices[u*3+(j+1)%3] == a)
+					opposite++;
+			}
+		}
+		if (opposite != 1) {
+			(*locked)[a] = 1;
+			(*locked)[b] = 1;
+		}
+	}}
+}
+
+struct Simplifier {
+	ScratchVector<Vec3f> positions;
+	ScratchVector<int> indices;
+	ScratchVector<Quadric> quadrics;
+	ScratchVector<uint8_t> locked;
+	VertexTriangles vt;
+
+	// per pass: vertices whose triangles changed
+	ScratchVector<uint8_t> touched;
+
+	// link condition scratch, stamps of the neighbours of a vertex
+	ScratchVector<int> marks;
+	int stamp = 0;
+
+	// Merging 'from' into 'to' keeps the surface a manifold if the two only
+	// share the neighbours across the triangles on their edge.
+	bool keeps_manifold(int from, int to, int edge_triangles)
+	{
+		const int from_stamp = ++stamp;
+		for (int t : vt.of(from)) {
+			for (int k = 0; k < 3; k++)
+				marks[indices[t*3+k]] = from_stamp;
+		}
+		const int common_stamp = ++stamp;
+		int common = 0;
+		for (int t : vt.of(to)) {
+			for (int k = 0; k < 3; k++) {
+				const int v = indices[t*3+k];
+				if (v != from && v != to && marks[v] == from_stamp) {
+					marks[v] = common_stamp;
+					common++;
+				}
+			}
+		}
+		return common == edge_triangles;
+	}
+
+	// a triangle's normal may not turn by more than about 75 degrees
+	bool flips(int from, int to)
+	{
+		for (int t : vt.of(from)) {
+			const int *tri = &indices[t*3];
+			if (tri[0] == to || tri[1] == to || tri[2] == to)
+				continue;
+
+			Vec3f p[3];
+			for (int k = 0; k < 3; k++)
+				p[k] = positions[tri[k]];
+			const Vec3f before = triangle_normal(p[0], p[1], p[2]);
+			for (int k = 0; k < 3; k++) {
+				if (tri[k] == from)
+					p[k] = positions[to];
+			}
+			const Vec3f after = triangle_normal(p[0], p[1], p[2]);
+			if (dot(before, after) <= 0.25f * length(before) * length(after))
+				return true;
+		}
+		return false;
+	}
+
+	// returns the number of triangles removed
+	int collapse(int from, int to)
+	{
+		int removed = 0;
+		for (int t : vt.of(from)) {
+			int *tri = &indices[t*3];
+			for (int k = 0; k < 3; k++) {
+				touched[tri[k]] = 1;
+				if (tri[k] == from)
+					tri[k] = to;
+			}
+			if (tri[0] == tri[1] || tri[1] == tri[2] || tri[2] == tri[0])
+				removed++;
+		}
+		touched[to] = 1;
+		quadrics[to].add(quadrics[from]);
+		return removed;
+	}
+
+	// One round of collapses, cheapest first, at most one around every
+	// vertex so that the adjacency stays valid. Returns false if nothing
+	// could be collapsed.
+	bool pass(ScratchVector<Collapse> *candidates, int target_triangles)
+	{
+		const int n_vertices = positions.length();
+		vt.build(indices, n_vertices);
+		candidates->clear();
+		for (int t = 0; t < indices.length() / 3; t++) {
+		for (int k = 0; k < 3; k++) {
+			const int a = indices[t*3+k];
+			const int b = indices[t*3+(k+1)%3];
+			// every inner edge is seen from both of its triangles
+			if (a > b)
+				continue;
+
+			Collapse c = {1e300, -1, -1};
+			if (!locked[a])
+				c = {quadrics[a].error(positions[b]) + quadrics[b].error(positions[b]), a, b};
+			if (!locked[b]) {
+				const double e = quadrics[a].error(positions[a]) + quadrics[b].error(positions[a]);
+				if (e < c.error)
+					c = {e, b, a};
+			}
+			if (c.from >= 0)
+				candidates->append(c);
+		}}
+		sort(candidates->sub(), [](const Collapse &a, const Collapse &b) {
+			return a.error < b.error;
+		});
+
+		touched.resize(n_vertices);
+		fill(touched.sub(), (uint8_t)0);
+		int n_triangles = indices.length() / 3;
+		bool collapsed = false;
+		for (const Collapse &c : *candidates) {
+			if (n_triangles <= target_triangles)
+				break;
+			if (touched[c.from] || touched[c.to])
+				continue;
+
+			int edge_triangles = 0;
+			for (int t : vt.of(c.from)) {
+				const int *tri = &indices[t*3];
+				edge_triangles += tri[0] == c.to || tri[1] == c.to || tri[2] == c.to;
+			}
+			if (!keeps_manifold(c.from, c.to, edge_triangles) || flips(c.from, c.to))
+				continue;
+
+			n_triangles -= collapse(c.from, c.to);
+			collapsed = true;
+		}
+
+		// drop the triangles which lost an edge
+		int n = 0;
+		for (int t = 0; t < indices.length() / 3; t++) {
+			const int a = indices[t*3+0];
+			const int b = indices[t*3+1];
+			const int c = indices[t*3+2];
+			if (a == b || b == c || c == a)
+				continue;
+			indices[n++] = a;
+			indices[n++] = b;
+			indices[n++] = c;
+		}
+		indices.resize(n);
+		return collapsed;
+	}
+};
+
+void simplify_mesh(Mesh *mesh, int target_triangles, bool flat)
+{
+	NG_ASSERT(mesh->indices.length() % 3 == 0);
+	if (mesh->indices.length() / 3 <= target_triangles)
+		return;
+
+	// everything but the result is temporary
+	ArenaScope scope(scratch_arena());
+	Simplifier s;
+	ScratchVector<int> remap;
+	if (flat) {
+		weld_positions(&s.positions, &remap, mesh->vertices);
+		s.indices.resize(mesh->indices.length());
+		for (int i = 0; i < mesh->indices.length(); i++)
+			s.indices[i] = remap[mesh->indices[i]];
+	} else {
+		s.positions.resize(mesh->vertices.length());
+		for (int i = 0; i < mesh->vertices.length(); i++)
+			s.positions[i] = mesh->vertices[i].position;
+		s.indices = mesh->indices.sub();
+	}
+
+	const int n_vertices = s.positions.length();
+	s.quadrics.resize(n_vertices);
+	for (int t = 0; t < s.indices.length() / 3; t++) {
+		const int *tri = &s.indices[t*3];
+		const Vec3f n = triangle_normal(s.positions[tri[0]], s.positions[tri[1]],
+			s.positions[tri[2]]);
+		const float area2 = length(n);
+		if (area2 == 0.0f)
+			continue;
+
+		const Vec3f un = n / Vec3f(area2);
+		const float d = -dot(un, s.positions[tri[0]]);
+		for (int k = 0; k < 3; k++)
+			s.quadrics[tri[k]].add_plane(un, d, area2 * 0.5f);
+	}
+
+	s.locked.resize(n_vertices);
+	fill(s.locked.sub(), (uint8_t)0);
+	s.vt.build(s.indices, n_vertices);
+	find_boundary(&s.locked, s.indices, s.vt);
+	s.marks.resize(n_vertices);
+	fill(s.marks.sub(), 0);
+
+	ScratchVector<Collapse> candidates;
+	while (s.indices.length() / 3 > target_triangles) {
+		if (!s.pass(&candidates, target_triangles))
+			break;
+	}
+
+	mesh->indices.clear();
+	if (flat) {
+		// every triangle gets its own vertices again
+		mesh->vertices.clear();
+		for (int t = 0; t < s.indices.length() / 3; t++) {
+			const Vec3f &a = s.positions[s.indices[t*3+0]];
+			const Vec3f &b = s.positions[s.indices[t*3+1]];
+			const Vec3f &c = s.positions[s.indices[t*3+2]];
+			const Vec3f n = normalize(triangle_normal(a, b, c));
+			for (const Vec3f &p : {a, b, c}) {
+				mesh->indices.append(mesh->vertices.length());
+				mesh->vertices.append({p, n});
+			}
+		}
+		return;
+	}
+
+	// only the vertices still in use are kept, in the order of first use
+	remap.resize(n_vertices);
+	fill(remap.sub(), -1);
+	ScratchVector<Vertex> vertices;
+	for (int idx : s.indices) {
+		if (remap[idx] < 0) {
+			remap[idx] = vertices.length();
+			vertices.append(mesh->vertices[idx]);
+		}
+		mesh->indices.append(remap[idx]);
+	}
+	mesh->vertices = vertices.sub();
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Mesh/Mesher.h"
+
+// Simplifies the mesh towards 'target_triangles' by collapsing edges, the
+// ones adding the least quadric error (Garland & Heckbert) first. A vertex
+// is only ever merged into one of its neighbours, no new positions are made
+// up. Vertices on the open boundary of the mesh never move: the boundary of a
+// chunk mesh is where it meets the next chunk, so simplified chunks still
+// line up with their neighbours, simplified or not. Collapses which would
+// flip a triangle or pinch the surface are skipped, so the target may not be
+// reached.
+//
+// Flat shaded meshes (MT_MARCHING_CUBES) don't share vertices, with 'flat'
+// they are welded by position first and the result gets face normals.
+// Otherwise every remaining vertex keeps its normal.
+void simplify_mesh(Mesh *mesh, int target_triangles, bool flat);
@@ -0,0 +1,138 @@
+#include "Mesh/SparseVolume.h"
+#include <cfloat>
+
+static MinMax compute_bounds(const float *voxels)
+{
+	MinMax mm = {voxels[0], voxels[0]};
+	for (int i = 1; i < SparseVolume::BRICK_VOLUME; i++) {
+		mm.min = std::min(mm.min, voxels[i]);
+		mm.max = std::max(mm.max, voxels[i]);
+	}
+	return mm;
+}
+
+static void free_brick(SparseVolume *v, SparseBrick *b)
+{
+	if (!b->voxels)
+		return;
+	free_memory(b->voxels);
+	b->voxels = nullptr;
+	v->n_allocated--;
+}
+
+static void allocate_brick(SparseVolume *v, SparseBrick *b)
+{
+	if (b->voxels)
+		return;
+	b->voxels = allocate_memory<float>(SparseVolume::BRICK_VOLUME);
+	v->n_allocated++;
+}
+
+SparseVolume::SparseVolume(const Vec3i &size, float value)
+{
+	reset(size, value);
+}
+
+SparseVolume::~SparseVolume()
+{
+	for (SparseBrick &b : bricks)
+		free_memory(b.voxels);
+}
+
+void SparseVolume::reset(const Vec3i &size, float value)
+{
+	NG_ASSERT(size >= Vec3i(1));
+	for (SparseBrick &b : bricks)
+		free_brick(this, &b);
+
+	this->size = size;
+	brick_dims = (size + Vec3i(BRICK_MASK)) / Vec3i(BRICK_SIZE);
+	bricks.resize(volume(brick_dims));
+	for (SparseBrick &b : bricks)
+		b.bounds = {value, value};
+}
+
+void SparseVolume::set(const Vec3i &p, float value)
+{
+	NG_ASSERT(Vec3i(0) <= p && p < size);
+	SparseBrick &b = bricks[brick_index(Vec3i(p.x >> BRICK_BITS,
+		p.y >> BRICK_BITS, p.z >> BRICK_BITS))];
+	if (!b.voxels) {
+		if (b.bounds.min == value)
+			return;
+		allocate_brick(this, &b);
+		for (int i = 0; i < BRICK_VOLUME; i++)
+			b.voxels[i] = b.bounds.min;
+	}
+	b.voxels[voxel_index(p)] = value;
+	b.bounds.min = std::min(b.bounds.min, value);
+	b.bounds.max = std::max(b.bounds.max, value);
+}
+
+void SparseVolume::set_brick(const Vec3i &bp, const float *voxels)
+{
+	SparseBrick &b = bricks[brick_index(bp)];
+	b.bounds = compute_bounds(voxels);
+	if (b.bounds.min == b.bounds.max) {
+		free_brick(this, &b);
+		return;
+	}
+	allocate_brick(this, &b);
+	copy_memory(b.voxels, voxels, BRICK_VOLUME);
+}
+
+void SparseVolume::compact_brick(const Vec3i &bp)
+{
+	SparseBrick &b = bricks[brick_index(bp)];
+	if (!b.voxels)
+		return;
+	b.bounds = compute_bounds(b.voxels);
+	if (b.bounds.min == b.bounds.max)
+		free_brick(this, &b);
+}
+
+MinMax SparseVolume::bounds(const Vec3i &min, const Vec3i &max) const
+{
+	const Vec3i bmin(min.x >> BRICK_BITS, min.y >> BRICK_BITS, min.z >> BRICK_BITS);
+	const Vec3i bmax(max.x >> BRICK_BITS, max.y >> BRICK_BITS, max.z >> BRICK_BITS);
+	MinMax mm = {FLT_MAX, -FLT_MAX};
+	for (int z = bmin.z; z <= bmax.z; z++) {
+	for (int y = bmin.y; y <= bmax.y; y++) {
+	for (int x = bmin.x; x <= bmax.x; x++) {
+		const MinMax &b = brick({x, y, z}).bounds;
+		mm.min = std::min(mm.min, b.min);
+		mm.max = std::max(mm.max, b.max);
+	}}}
+	return mm;
+}
+
+void SparseVolume::gather(float *out, const Vec3i &min, const Vec3i &dims) const
+{
+	NG_ASSERT(Vec3i(0) <= min && min + dims <= size);
+	const int x1 = min.x + dims.x;
+	for (int z = min.z; z < min.z + dims.z; z++) {
+	for (int y = min.y; y < min.y + dims.y; y++) {
+		int x = min.x;
+		while (x < x1) {
+			// the run of the row inside a single brick
+			const int run_end = std::min((x | BRICK_MASK) + 1, x1);
+			const int n = run_end - x;
+			const SparseBrick &b = brick(Vec3i(x >> BRICK_BITS,
+				y >> BRICK_BITS, z >> BRICK_BITS));
+			if (b.voxels) {
+				copy_memory(out, b.voxels + voxel_index({x, y, z}), n);
+			} else {
+				for (int i = 0; i < n; i++)
+					out[i] = b.bounds.min;
+			}
+			out += n;
+			x = run_end;
+		}
+	}}
+}
+
+int64_t SparseVolume::memory_usage() const
+{
+	return (int64_t)bricks.length() * sizeof(SparseBrick) +
+		(int64_t)n_allocated * BRICK_VOLUME * sizeof(float);
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "Core/Vector.h"
+#include "Math/Vec.h"
+#include "Mesh/BrickPyramid.h"
+
+struct SparseBrick {
+	// BRICK_SIZE^3 voxels or nullptr if all of them have the same value,
+	// which is then bounds.min (== bounds.max)
+	float *voxels = nullptr;
+
+	// conservative, may be wider than the actual values after set()
+	MinMax bounds = {0.0f, 0.0f};
+};
+
+// Voxel grid stored as a table of BRICK_SIZE^3 bricks, only bricks which have
+// varying values are allocated. Memory scales with the surface area as long as
+// the field is truncated (clamped to a narrow band around the surface), which
+// makes everything far away from the surface uniform.
+struct SparseVolume {
+	static constexpr int BRICK_BITS = 4;
+	static constexpr int BRICK_SIZE = 1 << BRICK_BITS;
+	static constexpr int BRICK_MASK = BRICK_SIZE - 1;
+	static constexpr int BRICK_VOLUME = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+
+	Vector<SparseBrick> bricks;
+	Vec3i size = Vec3i(0);
+	Vec3i brick_dims = Vec3i(0);
+	int n_allocated = 0;
+
+	NG_DELETE_COPY(SparseVolume);
+
+	SparseVolume() = default;
+	SparseVolume(const Vec3i &size, float value);
+	~SparseVolume();
+
+	// resets the volume to 'size' voxels of 'value'
+	void reset(const Vec3i &size, float value);
+
+	int brick_index(const Vec3i &b) const
+	{
+		return (b.z * brick_dims.y + b.y) * brick_dims.x + b.x;
+	}
+
+	static int voxel_index(const Vec3i &p)
+	{
+		return (((p.z & BRICK_MASK) << BRICK_BITS | (p.y & BRICK_MASK)) << BRICK_BITS) | (p.x & BRICK_MASK);
+	}
+
+	const SparseBrick &brick(const Vec3i &b) const { return bricks[brick_index(b)]; }
+
+	float get(const Vec3i &p) const
+	{
+		NG_ASSERT(Vec3i(0) <= p && p < size);
+		const SparseBrick &b = bricks[brick_index(Vec3i(p.x >> BRICK_BITS,
+			p.y >> BRICK_BITS, p.z >> BRICK_BITS))];
+		if (!b.voxels)
+			return b.bounds.min;
+		return b.voxels[voxel_index(p)];
+	}
+
+	void set(const Vec3i &p, float value);
+
+	// Replaces the contents of brick 'b' with 'voxels' (BRICK_SIZE^3 values
+	// in brick-local x, y, z order), the brick is freed if they're uniform.
+	void set_brick(const Vec3i &b, const float *voxels);
+
+	// Frees the brick if all of its voxels have the same value and tightens
+	// its bounds otherwise.
+	void compact_brick(const Vec3i &b);
+
+	// Fills the volume with f(Vec3i) for every voxel, brick by brick.
+	template <typename F>
+	void generate(F &&f)
+	{
+		float tmp[BRICK_VOLUME];
+		for (int bz = 0; bz < brick_dims.z; bz++) {
+		for (int by = 0; by < brick_dims.y; by++) {
+		for (int bx = 0; bx < brick_dims.x; bx++) {
+			const Vec3i base = Vec3i(bx, by, bz) * Vec3i(BRICK_SIZE);
+			const Vec3i end = min(base + Vec3i(BRICK_SIZE), size);
+			float *out = tmp;
+			for (int z = base.z; z < base.z + BRICK_SIZE; z++) {
+			for (int y = base.y; y < base.y + BRICK_SIZE; y++) {
+			for (int x = base.x; x < base.x + BRICK_SIZE; x++) {
+				// voxels past the end of the volume repeat the last one,
+				// so they don't keep bricks on the border from being uniform
+				*out++ = f(min(Vec3i(x, y, z), end - Vec3i(1)));
+			}}}
+			set_brick({bx, by, bz}, tmp);
+		}}}
+	}
+
+	// Calls f(brick coordinates, const SparseBrick&) for every allocated brick.
+	template <typename F>
+	void for_each_dense_brick(F &&f) const
+	{
+		for (int bz = 0; bz < brick_dims.z; bz++) {
+		for (int by = 0; by < brick_dims.y; by++) {
+		for (int bx = 0; bx < brick_dims.x; bx++) {
+			const SparseBrick &b = bricks[brick_index({bx, by, bz})];
+			if (b.voxels)
+				f(Vec3i(bx, by, bz), b);
+		}}}
+	}
+
+	// Conservative min/max of voxels [min, max] (inclusive).
+	MinMax bounds(const Vec3i &min, const Vec3i &max) const;
+
+	// Copies voxels [min, min + dims) into a dense grid laid out according to
+	// offset_3d, 'out' has to hold volume(dims) values.
+	void gather(float *out, const Vec3i &min, const Vec3i &dims) const;
+
+	int64_t memory_usage() const;
+};
@@ -0,0 +1,47 @@
+#include "Mesh/Terrain.h"
+#include "Mesh/Mesher.h"
+#include "Core/Parallel.h"
+
+TerrainGenerator::TerrainGenerator(int seed):
+	height_noise(seed), cave_noise(seed)
+{
+}
+
+void TerrainGenerator::generate(Slice<float> voxels, const Vec3i &origin,
+	const Vec3i &dims) const
+{
+	NG_ASSERT(voxels.length == volume(dims));
+
+	// the height only depends on x and z
+	ArenaScope scope(scratch_arena());
+	ScratchVector<float> heights(dims.x * dims.z);
+
+	// whole z layers, at least 16^3 voxels per task: every voxel costs a
+	// noise lookup or two, a task for less isn't worth waking a worker, so
+	// the small blocks edits generate run on the calling thread
+	const int64_t min_voxels = 16 * 16 * 16;
+	const int64_t layer = int64_t(dims.x) * dims.y;
+	const int64_t min_layers = (min_voxels + layer - 1) / std::max<int64_t>(layer, 1);
+	const int64_t grain = std::max(parallel_grain(dims.z, 0, default_scheduler()), min_layers);
+	parallel_for(dims.z, grain, [&](int z0, int z1) {
+		for (int z = z0; z < z1; z++) {
+		for (int x = 0; x < dims.x; x++) {
+			const float fx = (origin.x + x) * height_frequency;
+			const float fz = (origin.z + z) * height_frequency;
+			heights[z * dims.x + x] = height_noise.get(fx, fz) * 0.25f;
+		}}
+
+		for (int z = z0; z < z1; z++) {
+		for (int y = 0; y < dims.y; y++) {
+		for (int x = 0; x < dims.x; x++) {
+			const Vec3i p = origin + Vec3i(x, y, z);
+			const float fy = (float)p.y / height_scale;
+			float v = fy - 0.25f - heights[z * dims.x + x];
+			if (cave_amplitude != 0.0f) {
+				const Vec3f fp = ToVec3f(p) * Vec3f(cave_frequency);
+				v += cave_noise.get(fp.x, fp.y, fp.z) * cave_amplitude;
+			}
+			voxels[offset_3d({x, y, z}, dims)] = v;
+		}}}
+	});
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Core/Vector.h"
+#include "Math/Noise.h"
+
+// Height field terrain from 2D noise, optionally carved with 3D noise. The
+// field is defined for any integer voxel coordinates, so it can be generated
+// chunk by chunk.
+struct TerrainGenerator {
+	Noise2D height_noise;
+	Noise3D cave_noise;
+
+	// all in voxels
+	float height_scale = 65.0f;
+	float height_frequency = 1.0f / 16.0f;
+	float cave_frequency = 1.0f / 24.0f;
+
+	// 0 disables the caves
+	float cave_amplitude = 0.0f;
+
+	explicit TerrainGenerator(int seed);
+
+	// Fills 'voxels' with the 'dims' grid of voxels starting at 'origin',
+	// laid out according to offset_3d.
+	void generate(Slice<float> voxels, const Vec3i &origin, const Vec3i &dims) const;
+};
@@ -1,7 +1,7 @@
 #!/bin/bash
 
 case "$OSTYPE" in
-  darwin*)  g++ -std=c++11 -o MC MC.cpp Core/*.cpp Math/*.cpp -I. -framework OpenGL -framework GLUT ;; 
-  *)        g++ -std=c++11 -o MC MC.cpp Core/*.cpp Math/*.cpp -I. -lglut -lGL -lGLU ;;
+  darwin*)  g++ -std=c++11 -o MC MC.cpp Core/*.cpp Math/*.cpp Mesh/*.cpp -I. -pthread -framework OpenGL -framework GLUT ;; 
+  *)        g++ -std=c++11 -o MC MC.cpp Core/*.cpp Math/*.cpp Mesh/*.cpp -I. -pthread -lglut -lGL -lGLU ;;
 esac
 